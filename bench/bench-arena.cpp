@@ -0,0 +1,144 @@
+#include "priocpp/loop.h"
+#include "priocpp/api.h"
+#include "priocpp/task.h"
+#include "repromysql/mysql-async.h"
+#include "bench.h"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+using namespace prio;
+using namespace repromysql;
+
+// heap allocations and throughput of a 20 column SELECT, over the
+// binary protocol with and without the statement cache (which keeps
+// the result arena between executions) and over the text protocol.
+// allocations are counted process wide, so include the promise chain.
+
+static std::atomic<long long> allocations(0);
+
+void* operator new(size_t n)
+{
+	allocations++;
+	void* p = malloc(n ? n : 1);
+	if(!p) throw std::bad_alloc();
+	return p;
+}
+
+void* operator new[](size_t n)
+{
+	allocations++;
+	void* p = malloc(n ? n : 1);
+	if(!p) throw std::bad_alloc();
+	return p;
+}
+
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+
+static std::string columns_sql(bool param)
+{
+	const char* cols[] = { "id", "item", "value", "id+1", "concat(item,value)" };
+
+	std::string sql = "SELECT ";
+	for( int i = 0; i < 20; i++)
+	{
+		if(i) sql += ", ";
+		sql += cols[i%5];
+		sql += " AS c" + std::to_string(i);
+	}
+	sql += " FROM test WHERE id < ";
+	sql += param ? "?" : "3";
+	return sql;
+}
+
+typedef std::function<repro::Future<result_async::Ptr>(mysql_async::Ptr)> Query;
+
+void loop(mysql_async::Ptr m, Query q, int n, int* done)
+{
+	if( *done == n )
+	{
+		theLoop().exit();
+		return;
+	}
+
+	q(m)
+	.then( [m,q,n,done](result_async::Ptr r)
+	{
+		while(r->fetch())
+		{
+			r->field(1).view();
+		}
+		(*done)++;
+		loop(m,q,n,done);
+	})
+	.otherwise( [](const std::exception& ex)
+	{
+		std::cout << ex.what() << std::endl;
+		theLoop().exit();
+	});
+}
+
+void run(const std::string& name, Query q, int n, size_t statements)
+{
+	MysqlPool pool(bench::url(), 1);
+	pool.statement_cache(statements);
+
+	int done = 0;
+	long long before = 0;
+	bench::Stopwatch watch;
+
+	pool.con()
+	.then( [q,n,&done,&before,&watch](mysql_async::Ptr m)
+	{
+		before = allocations;
+		watch.reset();
+		loop(m,q,n,&done);
+	})
+	.otherwise( [](const std::exception& ex)
+	{
+		std::cout << ex.what() << std::endl;
+		theLoop().exit();
+	});
+
+	theLoop().run();
+
+	double secs = watch.elapsed();
+	long long allocs = allocations - before;
+
+	bench::report(name, done, secs);
+	std::cout << std::left << std::setw(32) << "" << std::right
+	          << std::setw(10) << (done ? allocs/done : 0) << " allocations per query" << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+	prio::Libraries<repromysql::MySQL,prio::EventLoop> init;
+
+	int n = bench::arg(argc,argv,1,5000);
+
+	std::string prepared = columns_sql(true);
+	std::string text = columns_sql(false);
+
+	Query binary = [prepared](mysql_async::Ptr m)
+	{
+		return prio::task( [m,prepared]()
+		{
+			auto stm = m->prepare(prepared);
+			stm->bind(1,3);
+			return stm->query();
+		});
+	};
+
+	run("prepared, cached statement", binary, n, 32);
+	run("prepared, uncached", binary, n, 0);
+
+	run("text", [text](mysql_async::Ptr m)
+	{
+		return m->query(text);
+	}, n, 32);
+
+	return 0;
+}
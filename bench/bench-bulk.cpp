@@ -0,0 +1,104 @@
+#include "priocpp/loop.h"
+#include "priocpp/api.h"
+#include "priocpp/task.h"
+#include "repromysql/mysql-async.h"
+#include "bench.h"
+
+using namespace prio;
+using namespace repromysql;
+
+// row throughput of a per row execute() loop vs multi row bulk inserts
+
+typedef std::vector<std::tuple<int,std::string,double>> Rows;
+
+void run(const std::string& name, MysqlPool::Mode mode, const Rows& rows, std::function<repro::Future<mysql_async::Ptr>(mysql_async::Ptr)> insert)
+{
+	MysqlPool pool(bench::url(), 1, mode);
+
+	bench::Stopwatch watch;
+
+	pool.execute("DELETE FROM bench_bulk")
+	.then( [&watch,insert](mysql_async::Ptr m)
+	{
+		watch.reset();
+		return insert(m);
+	})
+	.then( [&watch,&name,&rows](mysql_async::Ptr m)
+	{
+		bench::report(name,rows.size(),watch.elapsed());
+		theLoop().exit();
+	})
+	.otherwise( [](const std::exception& ex)
+	{
+		std::cout << ex.what() << std::endl;
+		theLoop().exit();
+	});
+
+	theLoop().run();
+}
+
+int main(int argc, char **argv) 
+{
+	prio::Libraries<repromysql::MySQL,prio::EventLoop> init;
+
+	int n = bench::arg(argc,argv,1,20000);
+
+	Rows rows;
+	for( int i = 0; i < n; i++)
+	{
+		rows.push_back( std::make_tuple(i, "row " + std::to_string(i), i*0.5) );
+	}
+
+	{
+		MysqlPool pool(bench::url(), 1);
+		pool.execute("CREATE TABLE IF NOT EXISTS bench_bulk (id int primary key, name varchar(64), amount double)")
+		.then( [](mysql_async::Ptr m)
+		{
+			theLoop().exit();
+		})
+		.otherwise( [](const std::exception& ex)
+		{
+			std::cout << ex.what() << std::endl;
+			theLoop().exit();
+		});
+		theLoop().run();
+	}
+
+	const std::string sql = "INSERT INTO bench_bulk (id,name,amount) VALUES (?,?,?)";
+
+	run("per row execute()", MysqlPool::THREADED, rows, [&sql,&rows](mysql_async::Ptr m)
+	{
+		return prio::task( [m,&sql,&rows]()
+		{
+			statement_async::Ptr stm = m->prepare(sql);
+			for( auto& row : rows)
+			{
+				stm->bind(1,std::get<0>(row));
+				stm->bind(2,std::get<1>(row));
+				stm->bind(3,std::get<2>(row),MYSQL_TYPE_DOUBLE);
+				stm->execute();
+			}
+			return m;
+		});
+	});
+
+	run("statement execute(rows)", MysqlPool::THREADED, rows, [&sql,&rows](mysql_async::Ptr m)
+	{
+		return prio::task( [m,&sql,&rows]()
+		{
+			return m->prepare(sql)->execute(rows);
+		});
+	});
+
+	run("bulk threaded", MysqlPool::THREADED, rows, [&sql,&rows](mysql_async::Ptr m)
+	{
+		return m->bulk(sql,rows);
+	});
+
+	run("bulk nonblocking", MysqlPool::NONBLOCKING, rows, [&sql,&rows](mysql_async::Ptr m)
+	{
+		return m->bulk(sql,rows);
+	});
+
+	return 0;
+}
@@ -0,0 +1,110 @@
+#include "priocpp/loop.h"
+#include "priocpp/api.h"
+#include "priocpp/task.h"
+#include "repromysql/mysql-async.h"
+#include "bench.h"
+
+using namespace prio;
+using namespace repromysql;
+
+// a report style aggregation, sum of amount and count of flagged rows,
+// over the same result read row by row through the Retval bindings
+// and drained with fetch_columns(). times include the fetch.
+
+typedef std::function<std::pair<double,long long>(result_async::Ptr)> Aggregate;
+
+void scan(MysqlPool& pool, const std::string& name, const std::string& sql, Aggregate agg)
+{
+	pool.con()
+	.then( [sql,agg](mysql_async::Ptr m)
+	{
+		return prio::task( [m,sql,agg]()
+		{
+			bench::Stopwatch watch;
+
+			statement_async::Ptr stm = m->prepare(sql);
+			auto result = agg(stm->query());
+			return std::make_pair(result.second,watch.elapsed());
+		});
+	})
+	.then( [name](std::pair<long long,double> p)
+	{
+		bench::report(name, p.first, p.second);
+		theLoop().exit();
+	})
+	.otherwise( [](const std::exception& ex)
+	{
+		std::cout << ex.what() << std::endl;
+		theLoop().exit();
+	});
+
+	theLoop().run();
+}
+
+int main(int argc, char **argv)
+{
+	prio::Libraries<repromysql::MySQL,prio::EventLoop> init;
+
+	int n = bench::arg(argc,argv,1,100000);
+
+	MysqlPool pool(bench::url(), 1);
+
+	std::vector<std::tuple<int,double,int,std::string>> rows;
+	for( int i = 0; i < n; i++)
+	{
+		rows.push_back( std::make_tuple(i, i*0.25, i%3, std::string(10 + i%20,'x')) );
+	}
+
+	pool.execute("DROP TABLE IF EXISTS bench_columns")
+	.then( [](mysql_async::Ptr m)
+	{
+		return m->execute("CREATE TABLE bench_columns (id int primary key, amount double, flag int, label varchar(64))");
+	})
+	.then( [&rows](mysql_async::Ptr m)
+	{
+		return m->bulk("INSERT INTO bench_columns (id,amount,flag,label) VALUES (?,?,?,?)",rows);
+	})
+	.then( [](mysql_async::Ptr m)
+	{
+		theLoop().exit();
+	})
+	.otherwise( [](const std::exception& ex)
+	{
+		std::cout << ex.what() << std::endl;
+		theLoop().exit();
+	});
+	theLoop().run();
+
+	std::string sql = "SELECT id, amount, flag, label FROM bench_columns";
+
+	scan(pool, "rows, fetch()", sql, [](result_async::Ptr r)
+	{
+		double sum = 0;
+		long long flagged = 0, n = 0;
+		while(r->fetch())
+		{
+			sum += r->field(1).getDouble();
+			flagged += r->field(2).getInt() == 0;
+			n++;
+		}
+		return std::make_pair(sum + flagged, n);
+	});
+
+	scan(pool, "columns, fetch_columns()", sql, [](result_async::Ptr r)
+	{
+		auto c = r->fetch_columns();
+		auto& amount = c->column(1).doubles;
+		auto& flag = c->column(2).ints;
+
+		double sum = 0;
+		long long flagged = 0;
+		for( size_t i = 0; i < c->rows(); i++)
+		{
+			sum += amount[i];
+			flagged += flag[i] == 0;
+		}
+		return std::make_pair(sum + flagged, (long long)c->rows());
+	});
+
+	return 0;
+}
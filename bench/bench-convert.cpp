@@ -0,0 +1,136 @@
+#include "repromysql/mysql-bindings.h"
+#include "bench.h"
+#include <sstream>
+#include <thread>
+
+using namespace repromysql;
+
+// numeric text conversion in the binding layer, no database needed.
+// the stream baseline is what Param::set and Retval::getNumber did
+// before: one stream per value, each touching the global locale.
+// run with more threads to see the locale contention.
+
+static std::vector<std::string> make_values(int n)
+{
+	std::vector<std::string> v;
+	v.reserve(n);
+	for( int i = 0; i < n; i++)
+	{
+		if( i % 2 )
+		{
+			v.push_back( std::to_string( (long long)i * 7919 - 1000000 ) );
+		}
+		else
+		{
+			v.push_back( std::to_string( i * 0.37 ) );
+		}
+	}
+	return v;
+}
+
+template<class F>
+void run(const std::string& name, int threads, int n, F f)
+{
+	std::vector<std::thread> workers;
+	bench::Stopwatch watch;
+
+	for( int t = 0; t < threads; t++)
+	{
+		workers.emplace_back( [f,n]()
+		{
+			f(n);
+		});
+	}
+	for( auto& w : workers)
+	{
+		w.join();
+	}
+
+	bench::report(name, (long long)n*threads, watch.elapsed());
+}
+
+int main(int argc, char **argv)
+{
+	int n = bench::arg(argc,argv,1,1000000);
+	int threads = bench::arg(argc,argv,2,1);
+
+	const std::vector<std::string> values = make_values(1000);
+	volatile double sink = 0;
+
+	run("stream parse", threads, n, [&values,&sink](int n)
+	{
+		double sum = 0;
+		for( int i = 0; i < n; i++)
+		{
+			std::istringstream iss(values[i%values.size()]);
+			double d;
+			iss >> d;
+			sum += d;
+		}
+		sink = sum;
+	});
+
+	run("Param::set(string,LONGLONG)", threads, n, [&values](int n)
+	{
+		Param p;
+		for( int i = 0; i < n; i++)
+		{
+			p.set( values[i%values.size()], MYSQL_TYPE_LONGLONG );
+		}
+	});
+
+	run("Param::set(string,DOUBLE)", threads, n, [&values](int n)
+	{
+		Param p;
+		for( int i = 0; i < n; i++)
+		{
+			p.set( values[i%values.size()], MYSQL_TYPE_DOUBLE );
+		}
+	});
+
+	run("Retval::getNumber<double>", threads, n, [&values,&sink](int n)
+	{
+		Retval r("value", MYSQL_TYPE_STRING);
+		double sum = 0;
+		for( int i = 0; i < n; i++)
+		{
+			const std::string& s = values[i%values.size()];
+			r.assign(s.c_str(),s.size());
+			sum += r.getNumber<double>();
+		}
+		sink = sum;
+	});
+
+	run("stream format", threads, n, [](int n)
+	{
+		size_t len = 0;
+		for( int i = 0; i < n; i++)
+		{
+			std::ostringstream oss;
+			oss << i * 0.37;
+			len += oss.str().size();
+		}
+		(void)len;
+	});
+
+	run("Param::set<double>(STRING)", threads, n, [](int n)
+	{
+		Param p;
+		for( int i = 0; i < n; i++)
+		{
+			p.set( i * 0.37, MYSQL_TYPE_STRING );
+		}
+	});
+
+	run("Param::set<long long>(STRING)", threads, n, [](int n)
+	{
+		Param p;
+		for( int i = 0; i < n; i++)
+		{
+			p.set( (long long)i * 7919, MYSQL_TYPE_STRING );
+		}
+	});
+
+	(void)sink;
+	return 0;
+}
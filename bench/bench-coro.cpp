@@ -0,0 +1,130 @@
+#include "priocpp/loop.h"
+#include "priocpp/api.h"
+#include "priocpp/task.h"
+#include "repromysql/mysql-async.h"
+#include "repromysql/mysql-coro.h"
+#include "bench.h"
+#include <atomic>
+#include <new>
+
+using namespace prio;
+using namespace repromysql;
+
+// sequential point lookups written as a promise chain and as a
+// coroutine. reports heap allocations per query and latency.
+
+static std::atomic<long long> allocations(0);
+
+void* operator new(size_t n)
+{
+	allocations++;
+	void* p = malloc(n ? n : 1);
+	if(!p) throw std::bad_alloc();
+	return p;
+}
+
+void operator delete(void* p) noexcept
+{
+	free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+	free(p);
+}
+
+void report_allocations(const std::string& name, long long allocs, int n)
+{
+	std::cout << std::left << std::setw(32) << name 
+	          << std::right << std::fixed << std::setprecision(1)
+	          << " " << std::setw(9) << (double)allocs/n << " allocations/query"
+	          << std::endl;
+}
+
+void chain(MysqlPool& pool, int i, int n, std::vector<double>& samples)
+{
+	if( i == n )
+	{
+		theLoop().exit();
+		return;
+	}
+
+	auto start = std::chrono::steady_clock::now();
+
+	pool.query("SELECT value from test where id = ?", 1 + i%2)
+	.then( [&pool,i,n,&samples,start](result_async::Ptr r)
+	{
+		while(r->fetch());
+		samples.push_back( std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() );
+		chain(pool,i+1,n,samples);
+	})
+	.otherwise( [](const std::exception& ex)
+	{
+		std::cout << ex.what() << std::endl;
+		theLoop().exit();
+	});
+}
+
+#ifdef REPROMYSQL_HAS_COROUTINES
+
+Task<> loop(MysqlPool& pool, int n, std::vector<double>& samples)
+{
+	for( int i = 0; i < n; i++)
+	{
+		auto start = std::chrono::steady_clock::now();
+
+		result_async::Ptr r = co_await pool.query("SELECT value from test where id = ?", 1 + i%2);
+		while(r->fetch());
+
+		samples.push_back( std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() );
+	}
+}
+
+#endif
+
+int main(int argc, char **argv) 
+{
+	prio::Libraries<repromysql::MySQL,prio::EventLoop> init;
+
+	int n = bench::arg(argc,argv,1,10000);
+
+	MysqlPool pool(bench::url(), 1);
+
+	std::vector<double> samples;
+	samples.reserve(n);
+
+	// warm up, connect time and statement cache misses are not measured
+	chain(pool,0,10,samples);
+	theLoop().run();
+
+	samples.clear();
+	long long before = allocations;
+	chain(pool,0,n,samples);
+	theLoop().run();
+	report_allocations("promise chain", allocations - before, n);
+	bench::report_latency("promise chain", samples);
+
+#ifdef REPROMYSQL_HAS_COROUTINES
+
+	samples.clear();
+	before = allocations;
+	loop(pool,n,samples).future()
+	.then( []()
+	{
+		theLoop().exit();
+	})
+	.otherwise( [](const std::exception& ex)
+	{
+		std::cout << ex.what() << std::endl;
+		theLoop().exit();
+	});
+	theLoop().run();
+	report_allocations("coroutine", allocations - before, n);
+	bench::report_latency("coroutine", samples);
+
+#else
+	std::cout << "coroutine: not supported by this compiler" << std::endl;
+#endif
+
+	return 0;
+}
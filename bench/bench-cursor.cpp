@@ -0,0 +1,95 @@
+#include "priocpp/loop.h"
+#include "priocpp/api.h"
+#include "priocpp/task.h"
+#include "repromysql/mysql-async.h"
+#include "bench.h"
+
+using namespace prio;
+using namespace repromysql;
+
+// full scans through a read only server side cursor,
+// sweeping the prefetch size for narrow and wide rows.
+// prefetch 0 is the buffered (store result) baseline.
+
+void scan(MysqlPool& pool, const std::string& name, const std::string& sql, unsigned long prefetch)
+{
+	pool.con()
+	.then( [sql,prefetch](mysql_async::Ptr m)
+	{
+		return prio::task( [m,sql,prefetch]()
+		{
+			bench::Stopwatch watch;
+
+			statement_async::Ptr stm = m->prepare(sql);
+			stm->cursor(prefetch);
+
+			long long n = 0;
+			result_async::Ptr r = stm->query();
+			while(r->fetch())
+			{
+				n++;
+			}
+			return std::make_pair(n,watch.elapsed());
+		});
+	})
+	.then( [name,prefetch](std::pair<long long,double> p)
+	{
+		bench::report(name + " prefetch " + std::to_string(prefetch), p.first, p.second);
+		theLoop().exit();
+	})
+	.otherwise( [](const std::exception& ex)
+	{
+		std::cout << ex.what() << std::endl;
+		theLoop().exit();
+	});
+
+	theLoop().run();
+}
+
+int main(int argc, char **argv) 
+{
+	prio::Libraries<repromysql::MySQL,prio::EventLoop> init;
+
+	int n = bench::arg(argc,argv,1,100000);
+
+	MysqlPool pool(bench::url(), 1);
+
+	std::vector<std::tuple<int,std::string>> rows;
+	for( int i = 0; i < n; i++)
+	{
+		rows.push_back( std::make_tuple(i, std::string(200 + i%800,'x')) );
+	}
+
+	pool.execute("DROP TABLE IF EXISTS bench_cursor")
+	.then( [&pool](mysql_async::Ptr m)
+	{
+		return m->execute("CREATE TABLE bench_cursor (id int primary key, payload varchar(1000))");
+	})
+	.then( [&rows](mysql_async::Ptr m)
+	{
+		return m->bulk("INSERT INTO bench_cursor (id,payload) VALUES (?,?)",rows);
+	})
+	.then( [](mysql_async::Ptr m)
+	{
+		theLoop().exit();
+	})
+	.otherwise( [](const std::exception& ex)
+	{
+		std::cout << ex.what() << std::endl;
+		theLoop().exit();
+	});
+	theLoop().run();
+
+	std::vector<unsigned long> sizes = { 0, 1, 10, 100, 1000, 10000 };
+
+	for( unsigned long prefetch : sizes)
+	{
+		scan(pool, "narrow", "SELECT id FROM bench_cursor", prefetch);
+	}
+	for( unsigned long prefetch : sizes)
+	{
+		scan(pool, "wide", "SELECT id, payload FROM bench_cursor", prefetch);
+	}
+
+	return 0;
+}
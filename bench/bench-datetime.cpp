@@ -0,0 +1,144 @@
+#include "repromysql/mysql-bindings.h"
+#include "bench.h"
+#include <regex>
+#include <sstream>
+
+using namespace repromysql;
+
+// datetime text conversion in the binding layer, no database needed.
+// the regex and stream versions replicate what Param::set and
+// Retval::getString did before, minus the debug print to stderr.
+
+static int asInt(const std::string& s)
+{
+	std::istringstream iss(s);
+	int i = 0;
+	iss >> i;
+	return i;
+}
+
+static void regex_parse(const std::string& s, MYSQL_TIME& t)
+{
+	memset(&t,0,sizeof(MYSQL_TIME));
+
+	std::cmatch res;
+	std::regex rx("^(\\d\\d\\d\\d)-(\\d\\d)-(\\d\\d) ?(\\d\\d)?:?(\\d\\d)?:?(\\d\\d)?");
+
+	std::regex_search(s.c_str(),res,rx);
+	int nmatches = res.size();
+
+	if ( nmatches > 1) t.year = asInt(res.str(1));
+	if ( nmatches > 2) t.month = asInt(res.str(2));
+	if ( nmatches > 3) t.day = asInt(res.str(3));
+	if ( nmatches > 4) t.hour = asInt(res.str(4));
+	if ( nmatches > 5) t.minute = asInt(res.str(5));
+	if ( nmatches > 6) t.second = asInt(res.str(6));
+
+	std::ostringstream oss;
+	oss << t.year << "-" << t.month << "-" << t.day << " ";
+	oss << t.hour << ":" << t.minute << ":" << t.second;
+	oss.str();
+}
+
+static std::string stream_format(const MYSQL_TIME& t)
+{
+	std::ostringstream oss;
+	oss << t.year << "-" << t.month << "-" << t.day << " ";
+	oss << t.hour << ":" << t.minute << ":" << t.second;
+	return oss.str();
+}
+
+template<class F>
+void run(const std::string& name, int n, F f)
+{
+	bench::Stopwatch watch;
+	f(n);
+	bench::report(name, n, watch.elapsed());
+}
+
+int main(int argc, char **argv)
+{
+	int n = bench::arg(argc,argv,1,200000);
+
+	std::vector<std::string> values;
+	for( int i = 0; i < 1000; i++)
+	{
+		MYSQL_TIME t;
+		memset(&t,0,sizeof(MYSQL_TIME));
+		t.year = 1990 + i%40;
+		t.month = 1 + i%12;
+		t.day = 1 + i%28;
+		t.hour = i%24;
+		t.minute = i%60;
+		t.second = (i*7)%60;
+		values.push_back(datetime::format(t,MYSQL_TYPE_DATETIME));
+	}
+
+	run("regex parse", n, [&values](int n)
+	{
+		MYSQL_TIME t;
+		for( int i = 0; i < n; i++)
+		{
+			regex_parse(values[i%values.size()],t);
+		}
+	});
+
+	run("Param::set(string,DATETIME)", n, [&values](int n)
+	{
+		Param p;
+		for( int i = 0; i < n; i++)
+		{
+			p.set( values[i%values.size()], MYSQL_TYPE_DATETIME );
+		}
+	});
+
+	run("Param::set(time_point)", n, [](int n)
+	{
+		Param p;
+		auto tp = datetime::clock::now();
+		for( int i = 0; i < n; i++)
+		{
+			p.set( tp + std::chrono::seconds(i) );
+		}
+	});
+
+	run("stream format", n, [](int n)
+	{
+		size_t len = 0;
+		MYSQL_TIME t = datetime::from_time_point(datetime::clock::now());
+		for( int i = 0; i < n; i++)
+		{
+			t.second = i%60;
+			len += stream_format(t).size();
+		}
+		(void)len;
+	});
+
+	run("Retval::getString(DATETIME)", n, [&values](int n)
+	{
+		Retval r("datum", MYSQL_TYPE_DATETIME);
+		size_t len = 0;
+		for( int i = 0; i < n; i++)
+		{
+			const std::string& s = values[i%values.size()];
+			r.assign(s.c_str(),s.size());
+			len += r.getString().size();
+		}
+		(void)len;
+	});
+
+	run("Retval::getTimePoint(DATETIME)", n, [&values](int n)
+	{
+		Retval r("datum", MYSQL_TYPE_DATETIME);
+		long long sum = 0;
+		for( int i = 0; i < n; i++)
+		{
+			const std::string& s = values[i%values.size()];
+			r.assign(s.c_str(),s.size());
+			sum += r.getTimePoint().time_since_epoch().count();
+		}
+		(void)sum;
+	});
+
+	return 0;
+}
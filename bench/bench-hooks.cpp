@@ -0,0 +1,102 @@
+#include "priocpp/loop.h"
+#include "priocpp/api.h"
+#include "priocpp/task.h"
+#include "repromysql/mysql-async.h"
+#include "bench.h"
+#include <atomic>
+
+using namespace prio;
+using namespace repromysql;
+
+// sequential point lookups without a hook, with a hook doing nothing
+// and with a hook feeding a per step duration sum, to show what 
+// instrumentation costs per query.
+
+class NoopHook : public QueryHook
+{
+public:
+	void on(Point point, clock::time_point when, const std::string& sql)
+	{}
+};
+
+class StepHook : public QueryHook
+{
+public:
+
+	void on(Point point, clock::time_point when, const std::string& sql)
+	{
+		// steps of one query run on a single thread
+		thread_local clock::time_point last;
+		if ( point != ACQUIRE )
+		{
+			nanos[point] += std::chrono::duration_cast<std::chrono::nanoseconds>(when-last).count();
+		}
+		last = when;
+	}
+
+	std::atomic<long long> nanos[RELEASE+1] = {};
+};
+
+void chain(MysqlPool& pool, int i, int n, std::vector<double>& samples)
+{
+	if( i == n )
+	{
+		theLoop().exit();
+		return;
+	}
+
+	auto start = std::chrono::steady_clock::now();
+
+	pool.query("SELECT value from test where id = ?", 1 + i%2)
+	.then( [&pool,i,n,&samples,start](result_async::Ptr r)
+	{
+		while(r->fetch());
+		samples.push_back( std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() );
+		chain(pool,i+1,n,samples);
+	})
+	.otherwise( [](const std::exception& ex)
+	{
+		std::cout << ex.what() << std::endl;
+		theLoop().exit();
+	});
+}
+
+void run(const std::string& name, MysqlPool& pool, QueryHook::Ptr hook, int n)
+{
+	std::vector<double> samples;
+	samples.reserve(n);
+
+	pool.hook(hook);
+	chain(pool,0,n,samples);
+	theLoop().run();
+
+	bench::report_latency(name, samples);
+}
+
+int main(int argc, char **argv) 
+{
+	prio::Libraries<repromysql::MySQL,prio::EventLoop> init;
+
+	int n = bench::arg(argc,argv,1,10000);
+
+	MysqlPool pool(bench::url(), 1);
+
+	// warm up, connect time and statement cache misses are not measured
+	run("warm up", pool, nullptr, 10);
+
+	run("no hook", pool, nullptr, n);
+	run("noop hook", pool, std::make_shared<NoopHook>(), n);
+
+	auto steps = std::make_shared<StepHook>();
+	run("step hook", pool, steps, n);
+
+	const char* names[] = { "acquire", "prepare", "bind", "execute", "store result", "first fetch", "release" };
+	for( int i = QueryHook::PREPARE; i <= QueryHook::RELEASE; i++)
+	{
+		std::cout << "  until " << std::left << std::setw(14) << names[i] 
+		          << std::right << std::fixed << std::setprecision(1) 
+		          << std::setw(9) << steps->nanos[i]/1000.0/n << " us" << std::endl;
+	}
+
+	return 0;
+}
@@ -0,0 +1,74 @@
+#include "priocpp/loop.h"
+#include "priocpp/api.h"
+#include "priocpp/task.h"
+#include "repromysql/mysql-async.h"
+#include "bench.h"
+
+using namespace prio;
+using namespace repromysql;
+
+// fire n point lookups at once and wait for all of them.
+// THREADED is capped by the prio::task worker pool, 
+// NONBLOCKING only by the pool capacity.
+
+void run(const std::string& name, MysqlPool::Mode mode, int n, int capacity)
+{
+	MysqlPool pool(bench::url(), capacity, mode);
+
+	int done = 0;
+	int errors = 0;
+
+	// warm up the pool so connect time is not measured
+	for( int i = 0; i < capacity; i++)
+	{
+		pool.query("SELECT 1")
+		.then( [&done,capacity](result_async::Ptr r)
+		{
+			if(++done == capacity) theLoop().exit();
+		})
+		.otherwise( [&done,&errors,capacity](const std::exception& ex)
+		{
+			errors++;
+			if(++done == capacity) theLoop().exit();
+		});
+	}
+	theLoop().run();
+
+	done = 0;
+	bench::Stopwatch watch;
+
+	for( int i = 0; i < n; i++)
+	{
+		pool.query("SELECT value from test where id = ?", 1 + i%2)
+		.then( [&done,n](result_async::Ptr r)
+		{
+			while(r->fetch());
+			if(++done == n) theLoop().exit();
+		})
+		.otherwise( [&done,&errors,n](const std::exception& ex)
+		{
+			errors++;
+			if(++done == n) theLoop().exit();
+		});
+	}
+	theLoop().run();
+
+	bench::report(name,n,watch.elapsed());
+	if(errors)
+	{
+		std::cout << errors << " errors" << std::endl;
+	}
+}
+
+int main(int argc, char **argv) 
+{
+	prio::Libraries<repromysql::MySQL,prio::EventLoop> init;
+
+	int n = bench::arg(argc,argv,1,10000);
+	int capacity = bench::arg(argc,argv,2,16);
+
+	run("threaded point lookup", MysqlPool::THREADED, n, capacity);
+	run("nonblocking point lookup", MysqlPool::NONBLOCKING, n, capacity);
+
+	return 0;
+}
@@ -0,0 +1,91 @@
+#include "priocpp/loop.h"
+#include "priocpp/api.h"
+#include "priocpp/task.h"
+#include "repromysql/mysql-async.h"
+#include "bench.h"
+
+using namespace prio;
+using namespace repromysql;
+
+// serial latency of a static query over the binary protocol 
+// (prepare, execute, store) vs the one round trip text protocol.
+// the statement cache is disabled so the prepare is paid every time,
+// as it was before parameterless queries took the text path.
+
+typedef std::function<repro::Future<result_async::Ptr>(mysql_async::Ptr)> Query;
+
+void loop(mysql_async::Ptr m, Query q, int n, std::vector<double>& samples)
+{
+	if( (int)samples.size() == n )
+	{
+		theLoop().exit();
+		return;
+	}
+
+	auto watch = std::make_shared<bench::Stopwatch>();
+	q(m)
+	.then( [m,q,n,&samples,watch](result_async::Ptr r)
+	{
+		while(r->fetch());
+		samples.push_back(watch->elapsed());
+		loop(m,q,n,samples);
+	})
+	.otherwise( [](const std::exception& ex)
+	{
+		std::cout << ex.what() << std::endl;
+		theLoop().exit();
+	});
+}
+
+void run(const std::string& name, const std::string& sql, Query q, int n)
+{
+	MysqlPool pool(bench::url(), 1);
+	pool.statement_cache(0);
+
+	std::vector<double> samples;
+
+	pool.con()
+	.then( [q,n,&samples](mysql_async::Ptr m)
+	{
+		loop(m,q,n,samples);
+	})
+	.otherwise( [](const std::exception& ex)
+	{
+		std::cout << ex.what() << std::endl;
+		theLoop().exit();
+	});
+
+	theLoop().run();
+
+	bench::report_latency(name + ": " + sql, samples);
+}
+
+int main(int argc, char **argv) 
+{
+	prio::Libraries<repromysql::MySQL,prio::EventLoop> init;
+
+	int n = bench::arg(argc,argv,1,5000);
+
+	std::vector<std::string> queries = {
+		"SELECT 1",
+		"SELECT * from test"
+	};
+
+	for( auto& sql : queries)
+	{
+		run("prepared", sql, [sql](mysql_async::Ptr m)
+		{
+			return prio::task( [m,sql]()
+			{
+				return m->prepare(sql)->query();
+			});
+		}, n);
+
+		run("text", sql, [sql](mysql_async::Ptr m)
+		{
+			return m->query(sql);
+		}, n);
+	}
+
+	return 0;
+}
@@ -2,6 +2,11 @@
 #define _MOL_DEF_GUARD_DEFINE_MOD_HTTP_REQUEST_MYSQL_DEF_GUARD_
 
 #include "repromysql/mysql-bindings.h"
+#include "repromysql/mysql-digest.h"
+#include "repromysql/mysql-arena.h"
+#include "repromysql/mysql-columns.h"
+#include <list>
+#include <unordered_map>
   
 //////////////////////////////////////////////////////////////
  
@@ -12,12 +17,74 @@ class result;
 class statement;
 
 
+// bounded LRU of prepared statements for one connection, keyed by SQL text.
+// a cached statement is handed out to one user at a time; asking for the
+// same SQL while it is busy prepares an uncached one.
+
+class StatementCache
+{
+public:
+
+	struct Entry
+	{
+		Entry(MYSQL_STMT* st);
+
+		// columns of a text protocol result, no statement behind it
+		Entry(std::shared_ptr<MYSQL_RES> res);
+		~Entry();
+
+		MYSQL_STMT* stmt;
+		std::shared_ptr<MYSQL_RES> meta;
+		int param_count;
+		int column_count;
+		std::vector<MYSQL_BIND>	bind;
+		std::vector<std::shared_ptr<Param>> params;
+		bool in_use;
+		uint64_t digest; // fingerprint, 0 until first recorded
+		ResultArena::Ptr arena; // bindings of the last result
+
+	private:
+		Entry(const Entry&) = delete;
+		Entry& operator=(const Entry&) = delete;
+	};
+
+	typedef std::shared_ptr<Entry> EntryPtr;
+
+	StatementCache(size_t capacity = 32);
+	~StatementCache() {}
+
+	// returns nullptr if mysql_stmt_prepare fails
+	EntryPtr checkout(MYSQL* con, const std::string& sql);
+
+	void clear();
+
+	size_t size() const { return lru_.size(); }
+	size_t capacity() const { return capacity_; }
+	void capacity(size_t c);
+
+	static EntryPtr prepare(MYSQL* con, const std::string& sql);
+
+private:
+
+	StatementCache(const StatementCache&) = delete;
+	StatementCache& operator=(const StatementCache&) = delete;
+
+	size_t limit(MYSQL* con);
+	void evict(size_t max);
+
+	size_t capacity_;
+	long long server_limit_;
+	std::list<std::pair<std::string,EntryPtr>> lru_;
+	std::unordered_map<std::string,std::list<std::pair<std::string,EntryPtr>>::iterator> index_;
+};
+
+
 class result : public std::enable_shared_from_this<result>
 {
 public:
 	typedef std::shared_ptr<result> Ptr;
 
-	result(std::shared_ptr<statement> st);
+	result(std::shared_ptr<statement> st, bool buffered = true);
 
 	~result() {}
 
@@ -26,11 +93,16 @@ public:
 	const int fields() const;
 	const Retval& field(int i) const;
 
+	// drains all remaining rows into one array per column
+	result_columns::Ptr fetch_columns();
+
 	std::shared_ptr<statement> st();
 	std::shared_ptr<mysql> con();
 
 private:
 
+	void truncated();
+
 	int column_count_;
 	std::vector<std::shared_ptr<Retval>> fields_;
 	std::shared_ptr<MYSQL_BIND> bind_;
@@ -41,11 +113,13 @@ private:
 class statement : public std::enable_shared_from_this<statement>
 {
 friend class result;
+friend class mysql;
 public:
 	typedef std::shared_ptr<statement> Ptr;
 
 	statement(std::shared_ptr<mysql> con,MYSQL_STMT* st);
-	~statement() {}
+	statement(std::shared_ptr<mysql> con,StatementCache::EntryPtr e);
+	~statement();
 
 	MYSQL_FIELD* field( int i ) const;
 	int param_count() const;
@@ -55,11 +129,11 @@ public:
 	void bind(int index, T value, enum_field_types t)
 	{
 		int i = index-1;
-		if ( i < 0 || i >= params_.size())
+		if ( i < 0 || i >= (int)entry_->params.size())
 		{
 			throw repro::Ex("invalid param index");
 		}
-		params_[i]->set(value,t);
+		entry_->params[i]->set(value,t);
 	}
 
 
@@ -67,29 +141,35 @@ public:
 	void bind(int index, T value)
 	{
 		int i = index-1;
-		if ( i < 0 || i >= params_.size())
+		if ( i < 0 || i >= (int)entry_->params.size())
 		{
 			throw repro::Ex("invalid param index");
 		}
-		params_[i]->set(value);
+		entry_->params[i]->set(value);
 	}
 
 	Ptr execute();
 	result::Ptr query();
 
+	// read only server side cursor fetching prefetch rows per round trip,
+	// 0 turns the cursor off
+	void cursor(unsigned long prefetch) { prefetch_ = prefetch; }
+	unsigned long prefetch() const { return prefetch_; }
+
 	std::shared_ptr<mysql> con();
 
 	MYSQL_STMT* st();
 
 private:
 
-	std::vector<MYSQL_BIND>	bind_;
-	std::vector<std::shared_ptr<Param>> params_;
+	void bind_params();
+	void digest(long long rows, bool error);
+
 	std::shared_ptr<mysql> mysql_;
-	std::shared_ptr<MYSQL_STMT> stmt_;
-	std::shared_ptr<MYSQL_RES> prepare_meta_result_;
-	int param_count_;
-	int column_count_;
+	StatementCache::EntryPtr entry_;
+	unsigned long prefetch_;
+	std::string sql_; // only kept with digests installed
+	DigestStats::clock::time_point prepared_;
 };
 
 
@@ -115,6 +195,12 @@ public:
 	MYSQL* con();
 	void close();
 
+	StatementCache& statements() { return statements_; }
+
+	// aggregate statistics per statement shape, nullptr disables
+	void digests(DigestStats::Ptr d) { digests_ = d; }
+	DigestStats::Ptr digests() const { return digests_; }
+
 	Ptr tx_start()
 	{
 		execute("START TRANSACTION");
@@ -144,6 +230,8 @@ public:
 private:
 	MYSQL* con_;
 	my_ulonglong id_;
+	StatementCache statements_;
+	DigestStats::Ptr digests_;
 };
 
 
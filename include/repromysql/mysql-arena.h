@@ -0,0 +1,51 @@
+#ifndef _MOL_DEF_GUARD_DEFINE_MOD_HTTP_REQUEST_MYSQL_ARENA_DEF_GUARD_
+#define _MOL_DEF_GUARD_DEFINE_MOD_HTTP_REQUEST_MYSQL_ARENA_DEF_GUARD_
+
+#include "repromysql/mysql-bindings.h"
+
+//////////////////////////////////////////////////////////////
+
+namespace repromysql {
+
+// the bindings of one result in a single allocation: MYSQL_BIND array,
+// Retvals and their string buffers back to back. the owner of a slot,
+// a cached statement or a connection, keeps the arena of its last
+// result, and the next result reuses it once nothing else holds it
+// and its buffers fit.
+
+class ResultArena
+{
+public:
+	typedef std::shared_ptr<ResultArena> Ptr;
+
+	// lays out the columns of meta, in the arena of slot if possible,
+	// and leaves the arena returned in slot
+	static Ptr acquire(Ptr& slot, MYSQL_RES* meta, bool buffered);
+
+	~ResultArena();
+
+	int columns() const { return columns_; }
+	MYSQL_BIND* binds() { return binds_; }
+	Retval& field(int i) { return fields_[i]; }
+	const Retval& field(int i) const { return fields_[i]; }
+
+private:
+
+	ResultArena(MYSQL_RES* meta, int columns, size_t capacity);
+
+	ResultArena(const ResultArena& rhs) = delete;
+	ResultArena& operator=(const ResultArena& rhs) = delete;
+
+	static Ptr create(MYSQL_RES* meta, int columns, size_t capacity);
+	bool fits(MYSQL_RES* meta, int columns, size_t capacity) const;
+
+	int columns_;
+	size_t capacity_;
+	MYSQL_BIND* binds_;
+	Retval* fields_;
+	char* data_;
+};
+
+}
+
+#endif
@@ -2,7 +2,14 @@
 #define _MOL_DEF_GUARD_DEFINE_MOD_HTTP_REQUEST_MYSQL_ASYNC_DEF_GUARD_
 
 #include "repromysql/mysql-api.h"
-#include "priocpp/res.h"
+#include "repromysql/mysql-pool.h"
+#include "repromysql/mysql-digest.h"
+#include "repromysql/mysql-cache.h"
+#include "repromysql/mysql-rows.h"
+#include <chrono>
+#include <iomanip>
+#include <limits>
+#include <tuple>
 
 //////////////////////////////////////////////////////////////
 
@@ -11,32 +18,79 @@ namespace repromysql {
 class mysql_async;
 class result_async;
 class statement_async;
+class nonblocking_call;
+class result_batch;
+class SlowQueryLog;
+struct SlowQuery;
 
 
 //////////////////////////////////////////////////////////////
 
 
+// what is known about the session of a pooled connection.
+// only its current borrower touches it
+
+struct SessionState
+{
+	size_t max_allowed_packet = 0; // 0 until asked
+	bool gtids = false; // session_track_gtids is OWN_GTID
+};
+
 struct MysqlLocator
 {
 	typedef MYSQL* type;
 
 	static repro::Future<type> retrieve(const std::string& url);
 	static void free( type t);
+
+	// prepared statement cache bound to the lifetime of connection t
+	static std::shared_ptr<StatementCache> statements(type t, size_t capacity);
+
+	// session state bound to the lifetime of connection t
+	static std::shared_ptr<SessionState> session(type t);
+};
+
+//////////////////////////////////////////////////////////////
+
+// instrumentation interface, see MysqlPool::hook. 
+// on() is called on whatever thread does the work, 
+// implementations must be cheap and thread safe.
+
+class QueryHook
+{
+public:
+	typedef std::shared_ptr<QueryHook> Ptr;
+	typedef std::chrono::steady_clock clock;
+
+	// ACQUIRE and RELEASE bracket a connection borrow, the others 
+	// mark the start of each step of a statement. text protocol 
+	// statements skip PREPARE and BIND
+	enum Point { ACQUIRE, PREPARE, BIND, EXECUTE, STORE_RESULT, FIRST_FETCH, RELEASE };
+
+	virtual ~QueryHook() {}
+
+	virtual void on(Point point, clock::time_point when, const std::string& sql) = 0;
 };
 
 //////////////////////////////////////////////////////////////
 
 class MysqlPool
 {
+friend class SlowQueryLog;
 public:
-	typedef prio::Resource::Pool<MysqlLocator> Pool;
+	typedef ConnectionPool Pool;
 	typedef Pool::ResourcePtr ResourcePtr;
 
-	MysqlPool(const std::string& url, int capacity = 4)
-		: url_(url), pool_(capacity)
+	// THREADED runs every round trip on a prio::task worker,
+	// NONBLOCKING drives the client library's *_nonblocking calls 
+	// from the event loop thread and never blocks a worker
+	enum Mode { THREADED, NONBLOCKING };
+
+	MysqlPool(const std::string& url, int capacity = 4, Mode mode = THREADED)
+		: url_(url), pool_(std::make_shared<Pool>(url,capacity)), mode_(mode), statements_(32)
 	{}
 
-	MysqlPool() {}
+	MysqlPool() : pool_(std::make_shared<Pool>("",4)), mode_(THREADED), statements_(32) {}
 
 	~MysqlPool() {}
 
@@ -46,9 +100,25 @@ public:
 	template<class ...Args>
 	repro::Future<std::shared_ptr<mysql_async>> execute(std::string sql, Args ... args);
 
+	template<class ... T>
+	repro::Future<std::shared_ptr<mysql_async>> bulk(std::string sql, std::vector<std::tuple<T...>> rows);
+
+	template<class F, class ...Args>
+	repro::Future<> stream(std::string sql, size_t batch, F consumer, Args ... args);
+
+	// query answered from the result cache when installed, rows are
+	// cached for ttl_ms. without a cache every call queries the server
+	template<class ...Args>
+	repro::Future<cached_result::Ptr> cached(int ttl_ms, std::string sql, Args ... args);
+
 	template<class F>
 	repro::Future<> tx( F fun );
 
+	// like tx() but resolves with the GTID the commit produced, 
+	// empty if the server has gtid_mode OFF
+	template<class F>
+	repro::Future<std::string> tx_gtid( F fun );
+
 	repro::Future<ResourcePtr> get();
 	repro::Future<ResourcePtr> operator()();
 
@@ -56,57 +126,187 @@ public:
 
 	void shutdown()
 	{
-		pool_.shutdown();
+		pool_->shutdown();
+	}
+
+	// opens n connections concurrently and keeps at least n idle 
+	// from then on. resolves when the pool is warm
+	repro::Future<> prewarm(size_t min_idle)
+	{
+		return pool_->prewarm(min_idle);
 	}
+
+	// background health checks on idle connections, in seconds. 0 disables
+	void keepalive(int secs) { pool_->keepalive(secs); }
+	void idle_timeout(int secs) { pool_->idle_timeout(secs); }
+	void max_lifetime(int secs) { pool_->max_lifetime(secs); }
+
+	// installs instrumentation for connections handed out from now on,
+	// nullptr removes it
+	void hook(QueryHook::Ptr h) { hook_ = h; }
+	QueryHook::Ptr hook() const { return hook_; }
+
+	// log statements slower than the log's threshold, nullptr disables
+	void slow_log(std::shared_ptr<SlowQueryLog> log) { slowlog_ = log; }
+
+	// aggregate statistics per statement shape, nullptr disables
+	void digests(DigestStats::Ptr d) { digests_ = d; }
+	DigestStats::Ptr digests() const { return digests_; }
+
+	// result cache for cached(), writes through this pool invalidate it.
+	// nullptr disables
+	void cache(ResultCache::Ptr c) { cache_ = c; }
+	ResultCache::Ptr cache() const { return cache_; }
+
+	// cheap snapshot of gauges, counters and the acquire wait histogram
+	PoolStats stats() const { return pool_->stats(); }
+
+	Mode mode() const { return mode_; }
+	void mode(Mode m) { mode_ = m; }
+
+	// max prepared statements cached per connection, 0 disables caching
+	size_t statement_cache() const { return statements_; }
+	void statement_cache(size_t n) { statements_ = n; }
+
 private:
 
 	std::string url_;
-	Pool pool_;
+	std::shared_ptr<Pool> pool_;
+	Mode mode_;
+	size_t statements_;
+	QueryHook::Ptr hook_;
+	std::shared_ptr<SlowQueryLog> slowlog_;
+	DigestStats::Ptr digests_;
+	ResultCache::Ptr cache_;
 };
 
 
-class result_async : public std::enable_shared_from_this<result_async>
+// rows copied out of a result, owning their buffers
+
+class result_batch
 {
 public:
-	typedef std::shared_ptr<result_async> Ptr;
+	typedef std::shared_ptr<result_batch> Ptr;
 
-	result_async(std::shared_ptr<statement_async> st);
+	result_batch(int column_count)
+		: column_count_(column_count)
+	{}
 
-	~result_async() 
+	size_t rows() const { return column_count_ ? cells_.size()/column_count_ : 0; }
+	const int fields() const { return column_count_; }
+
+	const Retval& field(size_t row, int i) const
 	{
-		REPRO_MONITOR_DECR(mysqlAsyncResult);
+		return cells_[row*column_count_+i];
 	}
 
+	const Retval& field(size_t row, const std::string& name) const;
+
+	void add(const result_async& r);
+
+private:
+	int column_count_;
+	std::vector<Retval> cells_;
+};
+
+
+class result_async : public std::enable_shared_from_this<result_async>
+{
+public:
+	typedef std::shared_ptr<result_async> Ptr;
+
+	// unbuffered results read rows off the socket on fetch() 
+	// and keep the connection busy until drained or cancelled.
+	// dropping one before fetch() returned false cancels it
+	result_async(std::shared_ptr<statement_async> st, bool buffered = true);
+	result_async(std::shared_ptr<mysql_async> con, std::shared_ptr<MYSQL_RES> res);
+
+	~result_async();
+
 	bool fetch();
 
 	const int fields() const;
 	const Retval& field(int i) const;
 	const Retval& field(const std::string& name) const;
 
+	// column metadata of either protocol
+	MYSQL_FIELD* field_meta(int i) const;
+
+	// reads all remaining rows into T, a std::tuple or an aggregate 
+	// with row_members. column types are checked once up front, 
+	// prepared statement rows are converted by the client library 
+	// straight into T. use std::optional members for NULL columns
+	template<class T>
+	std::vector<T> as();
+
+	// drains all remaining rows into one array per column, see
+	// result_columns. field() is left at the last row fetch() read
+	result_columns::Ptr fetch_columns();
+
+	// text protocol results, query() without parameters and every 
+	// NONBLOCKING query, hand out a statement that only describes the
+	// columns. its st() is nullptr and it cannot be run again
 	std::shared_ptr<statement_async> st();
 	std::shared_ptr<mysql_async> con();
 
+	// drop the connection instead of draining pending rows
+	void cancel();
+
+	typedef std::function<repro::Future<>(std::shared_ptr<result_batch>)> Consumer;
+
+	// called with consecutive pieces of a value
+	typedef std::function<void(const char* data, size_t len)> Sink;
+
+	// fetch() leaves long column i truncated instead of growing its
+	// buffer, read() then hands the whole value over in chunks
+	void chunked(int i);
+
+	// reads column i of the current row with mysql_stmt_fetch_column,
+	// chunk bytes at a time. nothing for NULL. on an unbuffered result
+	// only the client library's row buffer and one chunk are resident
+	void read(int i, Sink sink, size_t chunk = 64*1024);
+
+	// fetch batches of up to n rows on a worker and hand each to consumer,
+	// the next batch is only read once the consumer's future resolved
+	repro::Future<> stream(size_t n, Consumer consumer);
+
 private:
 
+	static void stream(Ptr r, size_t n, Consumer consumer, repro::Promise<> p);
+
+	void first_fetch();
+	void truncated();
+	void rebind();
+
 	result_async(const result_async&) = delete;
 	result_async& operator=(const result_async&) = delete;
 
 	int column_count_;
-	std::vector<std::shared_ptr<Retval>> fields_;
-	std::shared_ptr<MYSQL_BIND> bind_;
+	ResultArena::Ptr arena_;
+	std::vector<bool> chunked_;
 
 	std::shared_ptr<statement_async> st_;
+	std::shared_ptr<statement_async> text_st_; // see st()
+	std::shared_ptr<MYSQL_RES> res_;
+	std::shared_ptr<mysql_async> con_;
+	bool buffered_;
+	bool cancelled_;
+	bool fetched_;
+	bool drained_; // fetched up to MYSQL_NO_DATA
 };
 
 
 class statement_async : public std::enable_shared_from_this<statement_async>
 {
 friend class result;
+friend class result_async;
+friend class mysql_async;
 public:
 
 	typedef std::shared_ptr<statement_async> Ptr;
 
 	statement_async(std::shared_ptr<mysql_async> con,MYSQL_STMT* st);
+	statement_async(std::shared_ptr<mysql_async> con,StatementCache::EntryPtr e);
 	~statement_async();
 
 	MYSQL_FIELD* field( int i ) const;
@@ -117,11 +317,11 @@ public:
 	void bind(int index, T value, enum_field_types t)
 	{
 		int i = index-1;
-		if ( i < 0 || i >= (int)params_.size())
+		if ( i < 0 || i >= (int)entry_->params.size())
 		{
 			throw repro::Ex("invalid param index");
 		}
-		params_[i]->set(value,t);
+		entry_->params[i]->set(value,t);
 	}
 
 
@@ -129,30 +329,58 @@ public:
 	void bind(int index, T value)
 	{
 		int i = index-1;
-		if ( i < 0 || i >= (int)params_.size())
+		if ( i < 0 || i >= (int)entry_->params.size())
 		{
 			throw repro::Ex("invalid param index");
 		}
-		params_[i]->set(value);
+		entry_->params[i]->set(value);
 	}
 
 
-	result_async::Ptr query();
+	result_async::Ptr query(bool buffered = true);
 	std::shared_ptr<mysql_async> execute();
 
+	// read only server side cursor fetching prefetch rows per round trip,
+	// 0 turns the cursor off. cursor results are never buffered client side
+	void cursor(unsigned long prefetch) { prefetch_ = prefetch; }
+	unsigned long prefetch() const { return prefetch_; }
+
+	// executes the statement once per row without leaving the calling thread
+	template<class ... T>
+	std::shared_ptr<mysql_async> execute(const std::vector<std::tuple<T...>>& rows);
+
 	std::shared_ptr<mysql_async> con();
 
 	MYSQL_STMT* st();
 
+	// binds a copy of p
+	void bind(int index, const Param& p);
+
+	// fills the next chunk of a long value into buf, 0 at the end
+	typedef std::function<size_t(char* buf, size_t size)> Reader;
+
+	// sends parameter index as a BLOB with mysql_stmt_send_long_data
+	// when the statement next runs, reading it chunk bytes at a time
+	void upload(int index, Reader reader, size_t chunk = 64*1024);
+
 private:
 
-	std::vector<MYSQL_BIND>	bind_;
-	std::vector<std::shared_ptr<Param>> params_;
+	struct Upload
+	{
+		unsigned int index;
+		Reader reader;
+		size_t chunk;
+	};
+
+	void bind_params();
+	void send_long_data();
+
 	std::shared_ptr<mysql_async> mysql_;
-	std::shared_ptr<MYSQL_STMT> stmt_;
-	std::shared_ptr<MYSQL_RES> prepare_meta_result_;
-	int param_count_;
-	int column_count_;
+	StatementCache::EntryPtr entry_;
+	unsigned long prefetch_;
+	std::vector<Upload> uploads_;
+	std::string sql_; // only kept with a hook, slow log or digests installed
+	QueryHook::clock::time_point prepared_;
 };
 
 inline void binder(statement_async::Ptr& ptr, int i)
@@ -174,60 +402,351 @@ void binder(statement_async::Ptr& ptr,int i, T t, Args ... args)
 	binder(ptr,i,args...);
 }
 
+template<class ... T>
+std::shared_ptr<mysql_async> statement_async::execute(const std::vector<std::tuple<T...>>& rows)
+{
+	auto ptr = shared_from_this();
+	for( auto& row : rows)
+	{
+		std::apply( [&ptr](const T& ... t)
+		{
+			binder(ptr,1,t...);
+		}, row);
+		execute();
+	}
+	return mysql_;
+}
+
+//////////////////////////////////////////////////////////////
+
+// splits INSERT ... VALUES (?,?) [suffix] so the row group can be
+// repeated to insert many rows with one statement
+
+class bulk_sql
+{
+public:
+
+	// max placeholders per prepared statement
+	static const size_t max_params = 65535;
+
+	bulk_sql(const std::string& sql);
+
+	std::string operator()(size_t rows) const;
+
+	size_t params() const { return params_; }
+	size_t size(size_t rows) const;
+
+	// how many rows go into each statement, given the encoded 
+	// size of every row and the server's max_allowed_packet
+	std::vector<size_t> chunks(const std::vector<size_t>& row_sizes, size_t max_packet) const;
+
+private:
+	std::string prefix_;
+	std::string row_;
+	std::string suffix_;
+	size_t params_;
+};
+
+// conservative estimate of a value on the wire, 
+// text protocol escaping may double string sizes
+template<class T>
+size_t wire_size(const T& t)
+{
+	return 24;
+}
+
+inline size_t wire_size(const std::string& s)
+{
+	return s.size()*2+3;
+}
+
+inline size_t wire_size(const char* s)
+{
+	return strlen(s)*2+3;
+}
+
+template<class ... T>
+std::vector<size_t> wire_sizes(const std::vector<std::tuple<T...>>& rows)
+{
+	std::vector<size_t> sizes;
+	sizes.reserve(rows.size());
+	for( auto& row : rows)
+	{
+		sizes.push_back( std::apply( [](const T& ... t)
+		{
+			return (size_t(4) + ... + wire_size(t));
+		}, row));
+	}
+	return sizes;
+}
+
 
 class mysql_async : public std::enable_shared_from_this<mysql_async>
 {
 friend class statement_async;
 friend class result_async;
+friend class nonblocking_call;
+friend class MysqlPool;
 public:
 
 	typedef std::shared_ptr<mysql_async> Ptr;
 	typedef repro::Future<mysql_async::Ptr> FutureType;
 
 	mysql_async();
-	mysql_async(MysqlPool::ResourcePtr m);
+	mysql_async(
+		MysqlPool::ResourcePtr m, 
+		MysqlPool::Mode mode = MysqlPool::THREADED, 
+		size_t statements = 0, 
+		QueryHook::Ptr hook = nullptr, 
+		std::shared_ptr<SlowQueryLog> slowlog = nullptr,
+		DigestStats::Ptr digests = nullptr,
+		ResultCache::Ptr cache = nullptr
+	);
 	~mysql_async();
 
-	statement_async::Ptr prepare(std::string sql);
+	// uncached statements are closed once released, for one-off SQL
+	statement_async::Ptr prepare(std::string sql, bool cached = true);
 
 	template<class ...Args>
 	repro::Future<result_async::Ptr> query(std::string sql, Args ... args)
 	{
+		if(mode_ == MysqlPool::NONBLOCKING)
+		{
+			return nonblocking_query(text(sql,args...));
+		}
+
+		if( sizeof...(args) == 0 )
+		{
+			return report(text_query(sql));
+		}
+
 		auto ptr = shared_from_this();
-		return prio::task([ptr,sql,args...]()
+		return report(prio::task([ptr,sql,args...]()
 		{
 			statement_async::Ptr stm = ptr->prepare(sql);
 			binder(stm,1,args...);
 			return stm->query();
-		});
+		}));
 	}
 
 	template<class ...Args>
 	repro::Future<mysql_async::Ptr> execute(std::string sql, Args ... args)
 	{
+		if(mode_ == MysqlPool::NONBLOCKING)
+		{
+			return invalidating(sql,nonblocking_execute(text(sql,args...)));
+		}
+
+		if( sizeof...(args) == 0 )
+		{
+			return invalidating(sql,report(text_execute(sql)));
+		}
+
 		auto ptr = shared_from_this();
-		return prio::task([ptr,sql,args...]()
+		return invalidating(sql,report(prio::task([ptr,sql,args...]()
 		{
 			statement_async::Ptr stm = ptr->prepare(sql);
 			binder(stm,1,args...);
 			return stm->execute();
-		});
+		})));
+	}
+
+	// single round trip over the text protocol on a prio::task worker,
+	// used for statements without parameters
+	repro::Future<result_async::Ptr> text_query(const std::string& sql);
+	repro::Future<mysql_async::Ptr> text_execute(const std::string& sql);
+
+	// single round trip over the text protocol, driven by the event loop
+	repro::Future<result_async::Ptr> nonblocking_query(const std::string& sql);
+	repro::Future<mysql_async::Ptr> nonblocking_execute(const std::string& sql);
+
+	// expand ? placeholders client side into escaped SQL literals
+	template<class ...Args>
+	std::string text(const std::string& sql, Args ... args)
+	{
+		std::vector<std::string> values;
+		literals(values,args...);
+		return interpolate(sql,values);
+	}
+
+	// multi row INSERT, rows are split into as few statements
+	// as max_allowed_packet allows. several statements run in a 
+	// transaction of their own, all or nothing. inside an open 
+	// transaction or with autocommit off that is left to the caller
+	template<class ... T>
+	repro::Future<mysql_async::Ptr> bulk(std::string sql, std::vector<std::tuple<T...>> rows)
+	{
+		auto ptr = shared_from_this();
+
+		if(mode_ == MysqlPool::NONBLOCKING)
+		{
+			auto p = repro::promise<mysql_async::Ptr>();
+
+			nonblocking_max_allowed_packet()
+			.then( [ptr,sql,rows,p](size_t max_packet)
+			{
+				bulk_sql b(sql);
+				std::vector<size_t> chunks = b.chunks(wire_sizes(rows),max_packet);
+
+				std::vector<std::string> statements;
+				size_t offset = 0;
+				for( size_t n : chunks)
+				{
+					std::vector<std::string> values;
+					for( size_t i = offset; i < offset+n; i++)
+					{
+						std::apply( [ptr,&values](const T& ... t)
+						{
+							ptr->literals(values,t...);
+						}, rows[i]);
+					}
+					statements.push_back( interpolate(b(n),values) );
+					offset += n;
+				}
+
+				bool tx = statements.size() > 1 && ptr->autocommitting();
+				if(tx)
+				{
+					statements.insert(statements.begin(),"START TRANSACTION");
+					statements.push_back("COMMIT");
+				}
+
+				ptr->nonblocking_batch(statements)
+				.then( [p](mysql_async::Ptr m)
+				{
+					p.resolve(m);
+				})
+				.otherwise( [ptr,p,tx](const std::exception_ptr ex)
+				{
+					if(!tx)
+					{
+						p.reject(ex);
+						return;
+					}
+					ptr->nonblocking_execute("ROLLBACK")
+					.then( [p,ex](mysql_async::Ptr)
+					{
+						p.reject(ex);
+					})
+					.otherwise( [p,ex](const std::exception_ptr)
+					{
+						p.reject(ex);
+					});
+				});
+			})
+			.otherwise(reject(p));
+
+			return invalidating(sql,p.future());
+		}
+
+		return invalidating(sql,report(prio::task([ptr,sql,rows]()
+		{
+			bulk_sql b(sql);
+			std::vector<size_t> chunks = b.chunks(wire_sizes(rows),ptr->max_allowed_packet());
+
+			bool tx = chunks.size() > 1 && ptr->autocommitting();
+			if(tx)
+			{
+				ptr->text_round_trip("START TRANSACTION");
+			}
+
+			try
+			{
+				size_t offset = 0;
+				for( size_t n : chunks)
+				{
+					// one-off statements, they would only evict cached ones
+					statement_async::Ptr stm = ptr->prepare(b(n),false);
+
+					int index = 1;
+					for( size_t i = offset; i < offset+n; i++)
+					{
+						std::apply( [&stm,index](const T& ... t)
+						{
+							binder(stm,index,t...);
+						}, rows[i]);
+						index += sizeof...(T);
+					}
+
+					stm->execute();
+					offset += n;
+				}
+			}
+			catch(...)
+			{
+				if(tx)
+				{
+					mysql_query(ptr->con(),"ROLLBACK");
+				}
+				throw;
+			}
+
+			if(tx)
+			{
+				ptr->text_round_trip("COMMIT");
+			}
+			return ptr;
+		})));
+	}
+
+	// unbuffered query delivering rows in batches, see result_async::stream.
+	// streams always read on prio::task workers, in both pool modes
+	template<class F, class ...Args>
+	repro::Future<> stream(std::string sql, size_t batch, F consumer, Args ... args)
+	{
+		auto ptr = shared_from_this();
+		auto p = repro::promise<>();
+
+		prio::task([ptr,sql,args...]()
+		{
+			statement_async::Ptr stm = ptr->prepare(sql);
+			binder(stm,1,args...);
+			return stm->query(false);
+		})
+		.then( [ptr,p,batch,consumer](result_async::Ptr r)
+		{
+			ptr->flush_slow();
+			return r->stream(batch,consumer);
+		})
+		.then( [p]()
+		{
+			p.resolve();
+		})
+		.otherwise(reject(p));
+
+		return p.future();
 	}
 
 	my_ulonglong insert_id();
 
+	// asks the server to report the GTID of each commit on this session.
+	// the setting outlives the borrow, it is sent once per connection
+	repro::Future<mysql_async::Ptr> track_gtids();
+
+	// GTID reported with the last statement, empty if none
+	std::string gtid();
+
 	MYSQL* con();
 	void close();
 
+	MysqlPool::Mode mode() const { return mode_; }
+
 	repro::Future<mysql_async::Ptr> tx_start()
 	{
+		dirty_.clear();
+
+		if(mode_ == MysqlPool::NONBLOCKING)
+		{
+			return nonblocking_execute("START TRANSACTION");
+		}
+
 		Ptr ptr = shared_from_this();
 
 		return prio::task( [ptr] () {
 
 			if (mysql_query(ptr->con(),"START TRANSACTION"))
 			{
-				prio::Resource::invalidate(ptr->mysql_);
+				MysqlPool::Pool::invalidate(ptr->mysql_);
 				repro::Ex ex("mysql start tx failed");
 				throw ex;
 			}
@@ -254,10 +773,145 @@ public:
 		return std::string( &(buf[0]),len);
 	}
 
+	std::string literal(const std::string& s)
+	{
+		return "'" + quote(s) + "'";
+	}
+
+	std::string literal(const char* s)
+	{
+		return literal(std::string(s));
+	}
+
+	std::string literal(const MYSQL_TIME& t);
+
+	std::string literal(datetime::clock::time_point tp)
+	{
+		return literal(datetime::from_time_point(tp));
+	}
+
+	// numbers print unquoted, floating point round trips.
+	// characters are quoted strings of one
+	template<class T>
+	std::string literal(T t)
+	{
+		static_assert(std::is_arithmetic<T>::value, "no SQL literal for this type");
+
+		if constexpr(convert::is_char<T>())
+		{
+			return literal(std::string(1,(char)t));
+		}
+		else if constexpr(std::is_floating_point<T>::value)
+		{
+			if(!std::isfinite(t))
+			{
+				throw repro::Ex("no SQL literal for NaN or infinity");
+			}
+			return convert::format(t,std::numeric_limits<T>::max_digits10);
+		}
+		else
+		{
+			return convert::format(t);
+		}
+	}
 
 private:
 
+	void literals(std::vector<std::string>& values)
+	{}
+
+	template<class T, class ... Args>
+	void literals(std::vector<std::string>& values, T t, Args ... args)
+	{
+		values.push_back(literal(t));
+		literals(values,args...);
+	}
+
+	static std::string interpolate(const std::string& sql, const std::vector<std::string>& values);
+
+	void trace(QueryHook::Point point, const std::string& sql)
+	{
+		if(hook_)
+		{
+			hook_->on(point, QueryHook::clock::now(), sql);
+		}
+	}
+
+	std::shared_ptr<MYSQL_RES> text_round_trip(const std::string& sql);
+
+	// queues a statement slower than the slow log threshold, 
+	// called on the worker that ran it
+	void slow(
+		const std::string& sql, 
+		QueryHook::clock::time_point prepared, 
+		QueryHook::clock::time_point executing, 
+		QueryHook::clock::time_point executed, 
+		long long rows, 
+		const statement_async* st
+	);
+
+	// hands the queued slow statements to the log, on the event loop.
+	// whatever is left when the connection is released goes on the next tick
+	void flush_slow();
+
+	bool timed() const 
+	{ 
+		return slowlog_ || digests_; 
+	}
+
+	// adds a statement to the digest table. *id caches the fingerprint,
+	// without id sql gets fingerprinted on every call
+	void digest(uint64_t* id, const std::string& sql, QueryHook::clock::time_point start, long long rows, bool error);
+
+	// drops cached results of the tables sql wrote to once f succeeded
+	repro::Future<mysql_async::Ptr> invalidating(const std::string& sql, repro::Future<mysql_async::Ptr> f);
+	void written(const std::string& sql);
+
+	template<class T>
+	repro::Future<T> report(repro::Future<T> f)
+	{
+		if(!slowlog_)
+		{
+			return f;
+		}
+
+		auto ptr = shared_from_this();
+		auto p = repro::promise<T>();
+
+		f.then( [ptr,p](T t)
+		{
+			ptr->flush_slow();
+			p.resolve(t);
+		})
+		.otherwise( [ptr,p](const std::exception_ptr ex)
+		{
+			ptr->flush_slow();
+			p.reject(ex);
+		});
+
+		return p.future();
+	}
+
+	size_t max_allowed_packet();
+	repro::Future<size_t> nonblocking_max_allowed_packet();
+
+	// autocommit on and no transaction open
+	bool autocommitting();
+
+	repro::Future<mysql_async::Ptr> nonblocking_batch(std::vector<std::string> statements);
+	void nonblocking_batch(std::shared_ptr<std::vector<std::string>> statements, size_t i, repro::Promise<mysql_async::Ptr> p);
+
 	MysqlPool::ResourcePtr mysql_;
+	MysqlPool::Mode mode_;
+	size_t statements_;
+	QueryHook::Ptr hook_;
+	std::string sql_; // last statement, only kept when a hook is installed
+	std::shared_ptr<SlowQueryLog> slowlog_;
+	std::vector<std::shared_ptr<SlowQuery>> slow_; // not yet handed to the log
+	DigestStats::Ptr digests_;
+	ResultCache::Ptr cache_;
+	std::vector<std::string> dirty_; // tables written in the open transaction
+	ResultArena::Ptr arena_; // bindings of the last text result
 };
 
 
@@ -293,6 +947,41 @@ repro::Future<mysql_async::Ptr> MysqlPool::execute(std::string sql, Args ... arg
 	return p.future();
 }
 
+template<class ... T>
+repro::Future<mysql_async::Ptr> MysqlPool::bulk(std::string sql, std::vector<std::tuple<T...>> rows)
+{
+	auto p = repro::promise<mysql_async::Ptr>();
+
+	con()
+	.then( [p,sql,rows](mysql_async::Ptr m)
+	{
+		auto f = m->bulk(sql,rows);
+		p.resolve( f );
+	})
+	.otherwise(reject(p));
+
+	return p.future();
+}
+
+template<class F, class ...Args>
+repro::Future<> MysqlPool::stream(std::string sql, size_t batch, F consumer, Args ... args)
+{
+	auto p = repro::promise<>();
+
+	con()
+	.then( [p,sql,batch,consumer,args...](mysql_async::Ptr m)
+	{
+		return m->stream(sql,batch,consumer,args...);
+	})
+	.then( [p]()
+	{
+		p.resolve();
+	})
+	.otherwise(reject(p));
+
+	return p.future();
+}
+
 
 template<class F>
 repro::Future<> MysqlPool::tx(F fun)
@@ -330,6 +1019,188 @@ repro::Future<> MysqlPool::tx(F fun)
 	return p.future();
 }
 
+template<class T>
+std::vector<T> result_async::as()
+{
+	std::vector<T> rows;
+
+	T row{};
+	auto refs = typed::members(row);
+	typename typed::columns_of<decltype(refs)>::type columns;
+
+	if ( (int)std::tuple_size<decltype(refs)>::value != column_count_ )
+	{
+		throw repro::Ex("as(): column count does not match the result");
+	}
+
+	typed::each(columns, refs, [this](unsigned int i, auto& c, auto& )
+	{
+		MYSQL_FIELD* f = field_meta(i);
+		c.check(*f,i);
+		typed::sizer(c, f->max_length ? f->max_length : f->length, 0);
+	});
+
+	first_fetch();
+
+	if(res_)
+	{
+		while( MYSQL_ROW r = mysql_fetch_row(res_.get()) )
+		{
+			unsigned long* lengths = mysql_fetch_lengths(res_.get());
+			typed::each(columns, refs, [r,lengths](unsigned int i, auto& c, auto& t)
+			{
+				c.parse(r[i],lengths[i],t);
+			});
+			rows.push_back(std::move(row));
+		}
+		return rows;
+	}
+
+	if(!st_)
+	{
+		return rows;
+	}
+
+	std::vector<MYSQL_BIND> binds(column_count_);
+	memset(binds.data(),0,sizeof(MYSQL_BIND)*binds.size());
+	typed::each(columns, refs, [&binds](unsigned int i, auto& c, auto& t)
+	{
+		c.bind(binds[i],t);
+	});
+
+	MYSQL_STMT* st = st_->st();
+	if (mysql_stmt_bind_result(st, binds.data()))
+	{
+		throw repro::Ex("mysql_stmt_bind_result failed!");
+	}
+
+	try
+	{
+		while(true)
+		{
+			int rc = mysql_stmt_fetch(st);
+			if ( rc != 0 && rc != MYSQL_DATA_TRUNCATED )
+			{
+				drained_ = rc == MYSQL_NO_DATA;
+				break;
+			}
+
+			typed::each(columns, refs, [st,&binds](unsigned int i, auto& c, auto& t)
+			{
+				c.load(st,binds[i],i,t);
+			});
+			rows.push_back(std::move(row));
+		}
+	}
+	catch(...)
+	{
+		rebind();
+		throw;
+	}
+
+	rebind();
+	return rows;
+}
+
+template<class ...Args>
+repro::Future<cached_result::Ptr> MysqlPool::cached(int ttl_ms, std::string sql, Args ... args)
+{
+	auto p = repro::promise<cached_result::Ptr>();
+	ResultCache::Ptr cache = cache_;
+
+	if(!cache)
+	{
+		query(sql,args...)
+		.then( [p](result_async::Ptr r)
+		{
+			p.resolve( std::make_shared<cached_result>(CachedRows::materialize(*r)) );
+		})
+		.otherwise(reject(p));
+
+		return p.future();
+	}
+
+	std::string key = ResultCache::key(sql,args...);
+	CachedRows::Ptr rows = cache->get(key);
+	if(rows)
+	{
+		prio::nextTick([p,rows](){ p.resolve( std::make_shared<cached_result>(rows) ); });
+		return p.future();
+	}
+
+	// someone else is already asking the server
+	if(!cache->wait(key,p))
+	{
+		return p.future();
+	}
+
+	std::vector<std::string> tags = ResultCache::tables(sql);
+	uint64_t stamp = cache->stamp(tags);
+	auto ttl = std::chrono::milliseconds(ttl_ms);
+
+	query(sql,args...)
+	.then( [cache,key,tags,stamp,ttl](result_async::Ptr r)
+	{
+		cache->complete(key,CachedRows::materialize(*r),tags,stamp,ttl);
+	})
+	.otherwise( [cache,key](const std::exception_ptr ex)
+	{
+		cache->fail(key,ex);
+	});
+
+	return p.future();
+}
+
+template<class F>
+repro::Future<std::string> MysqlPool::tx_gtid(F fun)
+{
+	auto p = repro::promise<std::string>();
+
+	con()
+	.then( [p,fun](mysql_async::Ptr m)
+	{
+		// nothing to roll back before START TRANSACTION went through
+		auto started = std::make_shared<bool>(false);
+
+		m->track_gtids()
+		.then( [](mysql_async::Ptr a)
+		{
+			return a->tx_start();
+		})
+		.then( [fun,started](mysql_async::Ptr a)
+		{
+			*started = true;
+			return fun(a); // must be async
+		})
+		.then( [m]()
+		{
+			return m->commit();
+		})
+		.then( [p](mysql_async::Ptr a)
+		{
+			std::string gtid = a->gtid();
+			prio::nextTick([p,gtid](){ p.resolve(gtid); });
+		})
+		.otherwise( [p,m,started](const std::exception_ptr ex)
+		{
+			if(!*started)
+			{
+				p.reject(ex);
+				return;
+			}
+
+			m->rollback()
+			.then([p,ex](mysql_async::Ptr a)
+			{
+				p.reject(ex);
+			});
+		});
+	})
+	.otherwise(reject(p));
+
+	return p.future();
+}
+
 }
 
 #endif
@@ -5,6 +5,9 @@
 #include "priocpp/task.h"
 #include "reprocpp/promise.h"
 #include <mysql/mysql.h>
+#include "repromysql/mysql-convert.h"
+#include "repromysql/mysql-datetime.h"
+#include <string_view>
   
 
 #if LIBMYSQL_VERSION_ID > 79999
@@ -37,6 +40,15 @@ public:
 
 	char* operator[](size_t i);
 
+	// binary safe view of cell i, valid until the next fetch().
+	// NULL cells give an empty view with a nullptr data()
+	std::string_view view(size_t i) const
+	{
+		return row_[i] ? std::string_view(row_[i],lengths_[i]) : std::string_view();
+	}
+
+	bool null(size_t i) const { return row_[i] == nullptr; }
+
 	int num_fields();
 
 private:
@@ -47,6 +59,7 @@ private:
 	 std::shared_ptr<MYSQL_RES> result_;
 	 int num_fields_;
 	 MYSQL_ROW row_;
+	 unsigned long* lengths_;
 };
 
 ///////////////////////////////////////////////////////////////
@@ -87,6 +100,7 @@ protected:
 		  maxlen_(rhs.maxlen_),
 		  is_null_(rhs.is_null_),
 		  is_err_(rhs.is_err_),
+		  is_unsigned_(rhs.is_unsigned_),
 		  u_(rhs.u_)
 	{}
 
@@ -97,10 +111,12 @@ protected:
 		  maxlen_(std::move(rhs.maxlen_)),
 		  is_null_(std::move(rhs.is_null_)),
 		  is_err_(std::move(rhs.is_err_)),
+		  is_unsigned_(std::move(rhs.is_unsigned_)),
 		  u_(std::move(rhs.u_))
 	{
 		rhs.is_null_        = false;
 		rhs.is_err_         = false;
+		rhs.is_unsigned_    = false;
 
 		rhs.buf_.reset();
 		rhs.maxlen_  	    = 0;
@@ -112,6 +128,7 @@ protected:
 	long unsigned int	maxlen_;
 	mybool				is_null_;
 	mybool				is_err_;
+	mybool				is_unsigned_;
 
 	union
 	{
@@ -132,6 +149,14 @@ public:
 
 	Param();
 	Param( enum_field_types type, int size );
+
+	// copies share the value buffer, set() replaces it
+	Param(const Param& rhs)
+		: Binding(rhs)
+	{
+		REPRO_MONITOR_INCR(mysqlParam);	
+	}
+
 	~Param()
 	{
 		REPRO_MONITOR_DECR(mysqlParam);	
@@ -141,10 +166,39 @@ public:
 	void set( const char* s, enum_field_types type= MYSQL_TYPE_STRING);
 	void set( MYSQL_TIME& ts, enum_field_types type= MYSQL_TYPE_DATETIME);
 
+	// binds the UTC calendar time, no text round trip
+	void set( datetime::clock::time_point tp, enum_field_types type= MYSQL_TYPE_DATETIME);
+
+#if __cpp_lib_chrono >= 201907L
+	void set( std::chrono::year_month_day ymd, enum_field_types type= MYSQL_TYPE_DATE)
+	{
+		MYSQL_TIME t = datetime::from_date(ymd);
+		set(t,type);
+	}
+#endif
+
+	// floating point and 64 bit values keep their width by default,
+	// unsigned values bind as unsigned
+	void set( double d, enum_field_types type= MYSQL_TYPE_DOUBLE)
+	{
+		set<double>(d,type);
+	}
+
+	void set( float f, enum_field_types type= MYSQL_TYPE_DOUBLE)
+	{
+		set<float>(f,type);
+	}
+
+	void set( long long l, enum_field_types type= MYSQL_TYPE_LONGLONG)
+	{
+		set<long long>(l,type);
+	}
+
 	template<class T>
-	void set( T t, enum_field_types type = MYSQL_TYPE_LONG  )
+	void set( T t, enum_field_types type = sizeof(T) > 4 ? MYSQL_TYPE_LONGLONG : MYSQL_TYPE_LONG )
 	{
 		type_ = type;
+		is_unsigned_ = std::is_unsigned<T>::value;
 		switch(type_)
 		{
 			case MYSQL_TYPE_TINY:
@@ -181,15 +235,11 @@ public:
 			case MYSQL_TYPE_DECIMAL:
 			case MYSQL_TYPE_NEWDECIMAL:
 			{
-				std::ostringstream oss;
-				oss << t;
-				std::string s = oss.str();
-
-				int n = s.size()+1;
-				char* buf = new char[n];
-				strncpy(buf,s.c_str(),n);
+				char* buf = new char[32];
+				size_t n = convert::format(t,buf,31);
+				buf[n] = 0;
 				buf_.reset(buf,[](const char* c){delete[] c;});
-				u_.strlen_ = s.size();
+				u_.strlen_ = n;
 				break;
 			}
 			default :
@@ -211,11 +261,25 @@ class Retval : public Binding
 public:
 
 
-	Retval( const char* name, enum_field_types type, int size = 256 );
+	Retval( const char* name, enum_field_types type, unsigned long size = 256 );
+
+	// string types use buf of size+1 bytes without owning it, see use()
+	Retval( const char* name, enum_field_types type, char* buf, unsigned long size );
+
+	// string buffer for a result column: the widest value of a stored
+	// result, otherwise a small start that grows on truncation
+	static unsigned long buffer_size(const MYSQL_FIELD* field, bool buffered);
+
+	static bool is_string(enum_field_types type);
 
 	Retval(const Retval& rhs)
 		: Binding(rhs), name_(rhs.name_)
 	{
+		// copies may outlive a borrowed buffer
+		if ( borrowed() )
+		{
+			detach();
+		}
 		REPRO_MONITOR_INCR(mysqlRetval);	
 	}
 
@@ -233,13 +297,53 @@ public:
 
 	bool operator()();
 
-	std::string name() const { return name_; }
+	// load a text protocol cell, len excludes the terminating NUL.
+	// a nullptr s marks the cell as NULL
+	void assign(const char* s, unsigned long len);
+
+	// take a private, tightly sized copy of a shared string buffer
+	void detach();
+
+	// points a string typed cell at buf of size+1 bytes owned by
+	// someone else, as result arenas do. clears the value
+	void use(char* buf, unsigned long size);
+
+	bool borrowed() const { return buf_ && buf_.use_count() == 0; }
+
+	// after MYSQL_DATA_TRUNCATED: grows the buffer, points b at it and
+	// reads column i of the current row again. false if this cell
+	// was not truncated. b has to be rebound for the next rows
+	bool refetch(MYSQL_STMT* st, MYSQL_BIND& b, unsigned int i);
+
+	// appends the cell's value to out, strings with a terminating NUL.
+	// NULL cells are tracked by the caller
+	void pack(std::string& out) const;
+
+	// loads a packed value. strings point into data, which owner keeps alive
+	void unpack(const char* data, unsigned long len, const std::shared_ptr<const void>& owner);
+
+	const std::string& name() const { return name_; }
 
 	const std::string getString() const;
+
+	// binary safe view of a string typed cell without a copy, valid 
+	// until the next fetch. empty for NULL and for other types
+	std::string_view view() const;
+
 	const int getInt() const;
 	const float getFloat() const;
 	const double getDouble() const;
 	const MYSQL_TIME& getTime() const;
+
+	// dates and times read as UTC, strings are parsed
+	datetime::clock::time_point getTimePoint() const;
+
+#if __cpp_lib_chrono >= 201907L
+	std::chrono::year_month_day getDate() const
+	{
+		return datetime::to_date(u_.timeval_);
+	}
+#endif
 	const long long int getLongLong() const;
 
 	template<class T>
@@ -285,10 +389,7 @@ public:
 				if (is_err_)
 					return 0;
 
-				std::istringstream iss( buf_.get() );
-				T t;
-				iss >> t;
-				return t;
+				return convert::parse<T>(view());
 			}
 			case MYSQL_TYPE_NULL:
 			{
@@ -0,0 +1,175 @@
+#ifndef _MOL_DEF_GUARD_DEFINE_MOD_HTTP_REQUEST_MYSQL_CACHE_DEF_GUARD_
+#define _MOL_DEF_GUARD_DEFINE_MOD_HTTP_REQUEST_MYSQL_CACHE_DEF_GUARD_
+
+#include "repromysql/mysql-bindings.h"
+#include <chrono>
+#include <list>
+#include <mutex>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+
+//////////////////////////////////////////////////////////////
+
+namespace repromysql {
+
+class result_async;
+
+// the rows of a result packed into one buffer. columns are kept once
+// as prototypes, cells are stored back to back: value bytes for numbers
+// and dates, NUL terminated bytes for strings.
+
+class CachedRows
+{
+public:
+	typedef std::shared_ptr<const CachedRows> Ptr;
+
+	// drains a buffered result
+	static std::shared_ptr<CachedRows> materialize(result_async& r);
+
+	size_t rows() const { return columns_.empty() ? 0 : nulls_.size()/columns_.size(); }
+	int fields() const { return (int)columns_.size(); }
+
+	// approximate memory footprint, charged against the cache budget
+	size_t bytes() const;
+
+	const std::vector<Retval>& columns() const { return columns_; }
+
+	// loads cell (row,col) into r, owner is this object
+	void load(size_t row, int col, Retval& r, const std::shared_ptr<const void>& owner) const;
+
+private:
+
+	std::vector<Retval> columns_;
+	std::string data_;
+	std::vector<uint32_t> offsets_; // one per cell plus end
+	std::vector<bool> nulls_;
+};
+
+// reads a cached result like a result_async. cells of string type
+// point into the shared cache buffer, nothing is copied per row
+
+class cached_result
+{
+public:
+	typedef std::shared_ptr<cached_result> Ptr;
+
+	cached_result(CachedRows::Ptr rows);
+
+	bool fetch();
+
+	size_t rows() const { return rows_->rows(); }
+	const int fields() const { return rows_->fields(); }
+	const Retval& field(int i) const;
+	const Retval& field(const std::string& name) const;
+
+private:
+
+	CachedRows::Ptr rows_;
+	std::vector<Retval> row_;
+	size_t next_;
+};
+
+// in process cache of query results, keyed by SQL plus bound values.
+// entries expire after their TTL, are evicted least recently used
+// beyond the memory budget and are tagged with the tables their SQL
+// reads. writes through a pool with the cache installed drop the
+// entries of the tables they touch. concurrent misses on one key
+// wait for a single query.
+
+class ResultCache
+{
+public:
+	typedef std::shared_ptr<ResultCache> Ptr;
+	typedef std::chrono::steady_clock clock;
+	typedef repro::Promise<cached_result::Ptr> Waiter;
+
+	struct Stats
+	{
+		unsigned long long hits = 0;
+		unsigned long long misses = 0;
+		unsigned long long coalesced = 0;
+		unsigned long long evictions = 0;
+		unsigned long long invalidations = 0;
+		size_t entries = 0;
+		size_t bytes = 0;
+	};
+
+	ResultCache(size_t max_bytes = 64*1024*1024);
+
+	ResultCache(const ResultCache& rhs) = delete;
+	ResultCache& operator=(const ResultCache& rhs) = delete;
+
+	template<class ...Args>
+	static std::string key(const std::string& sql, Args ... args)
+	{
+		std::string k(sql);
+		int unused[] = { 0, (append(k,args),0)... };
+		(void)unused;
+		return k;
+	}
+
+	// lower case names of the tables sql reads or writes
+	static std::vector<std::string> tables(const std::string& sql);
+
+	// nullptr on a miss
+	CachedRows::Ptr get(const std::string& key);
+
+	// true if the caller is the first miss and has to run the query,
+	// otherwise w gets resolved once that query completes
+	bool wait(const std::string& key, Waiter w);
+
+	// sum of the tag generations, taken before the query runs
+	uint64_t stamp(const std::vector<std::string>& tags);
+
+	// stores rows unless a tag got invalidated since stamp,
+	// and resolves everyone waiting on key
+	void complete(const std::string& key, std::shared_ptr<CachedRows> rows, const std::vector<std::string>& tags, uint64_t stamp, clock::duration ttl);
+	void fail(const std::string& key, const std::exception_ptr ex);
+
+	void invalidate(const std::string& table);
+	void clear();
+
+	Stats stats() const;
+
+private:
+
+	struct Entry
+	{
+		CachedRows::Ptr rows;
+		clock::time_point expires;
+		std::vector<std::string> tags;
+		std::list<std::string>::iterator lru;
+	};
+
+	static void append(std::string& k, const std::string& s);
+	static void append(std::string& k, const char* s);
+	static void append(std::string& k, const MYSQL_TIME& t);
+	static void append(std::string& k, datetime::clock::time_point tp);
+
+	template<class T, typename std::enable_if<std::is_arithmetic<T>::value,int>::type = 0>
+	static void append(std::string& k, T t)
+	{
+		k.push_back('\x1f');
+		k.append( (const char*)&t, sizeof(T) );
+	}
+
+	void erase(std::unordered_map<std::string,Entry>::iterator it);
+	void evict();
+
+	size_t max_bytes_;
+	size_t bytes_;
+
+	std::unordered_map<std::string,Entry> entries_;
+	std::list<std::string> lru_; // most recent first
+	std::unordered_map<std::string,std::unordered_set<std::string>> tagged_;
+	std::unordered_map<std::string,uint64_t> generations_;
+	std::unordered_map<std::string,std::vector<Waiter>> waiting_;
+
+	Stats stats_;
+	mutable std::mutex mutex_;
+};
+
+}
+
+#endif
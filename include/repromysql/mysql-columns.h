@@ -0,0 +1,82 @@
+#ifndef _MOL_DEF_GUARD_DEFINE_MOD_HTTP_REQUEST_MYSQL_COLUMNS_DEF_GUARD_
+#define _MOL_DEF_GUARD_DEFINE_MOD_HTTP_REQUEST_MYSQL_COLUMNS_DEF_GUARD_
+
+#include "repromysql/mysql-bindings.h"
+#include <cstdint>
+#include <vector>
+
+//////////////////////////////////////////////////////////////
+
+namespace repromysql {
+
+// a whole result drained into one contiguous array per column, for
+// aggregations and filters that run down a column:
+//
+// INT64   integer columns, and dates and times as microseconds
+//         since the epoch, UTC (datetime::micros)
+// DOUBLE  FLOAT, DOUBLE and DECIMAL columns
+// STRING  everything else, bytes back to back in data, value r is
+//         data[offsets[r]] to data[offsets[r+1]]
+//
+// bit r of nulls is set if row r is NULL. NULL cells hold 0, or an
+// empty string, so sums run without looking at the bitmap.
+// BIGINT UNSIGNED values above INT64_MAX wrap.
+
+class result_columns
+{
+public:
+	typedef std::shared_ptr<result_columns> Ptr;
+
+	enum Kind { INT64, DOUBLE, STRING };
+
+	struct Column
+	{
+		std::string name;
+		enum_field_types type;
+		Kind kind;
+		bool is_unsigned;
+
+		std::vector<int64_t> ints;
+		std::vector<double> doubles;
+		std::vector<uint64_t> offsets;
+		std::vector<char> data;
+		std::vector<uint64_t> nulls;
+
+		bool null(size_t row) const
+		{
+			return (nulls[row/64] >> (row%64)) & 1;
+		}
+
+		std::string_view str(size_t row) const
+		{
+			return std::string_view(data.data()+offsets[row], offsets[row+1]-offsets[row]);
+		}
+	};
+
+	result_columns();
+
+	size_t rows() const { return rows_; }
+	int fields() const { return (int)columns_.size(); }
+
+	const Column& column(int i) const { return columns_[i]; }
+	const Column& column(const std::string& name) const;
+
+	// drain a prepared statement result bound to nothing else, meta
+	// describes its columns. the caller rebinds its own buffers after
+	void load(MYSQL_STMT* st, MYSQL_RES* meta);
+
+	// drain a text protocol result
+	void load(MYSQL_RES* res);
+
+private:
+
+	void init(MYSQL_RES* meta, size_t rows);
+	void next_row();
+
+	std::vector<Column> columns_;
+	size_t rows_;
+};
+
+}
+
+#endif
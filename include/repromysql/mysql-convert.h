@@ -0,0 +1,158 @@
+#ifndef _MOL_DEF_GUARD_DEFINE_MOD_HTTP_REQUEST_MYSQL_CONVERT_DEF_GUARD_
+#define _MOL_DEF_GUARD_DEFINE_MOD_HTTP_REQUEST_MYSQL_CONVERT_DEF_GUARD_
+
+#include <charconv>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+//////////////////////////////////////////////////////////////
+
+namespace repromysql {
+
+// numbers to and from text without streams, so no allocation and no
+// locale lock per value. results match operator>> and operator<< on a
+// default constructed stream: leading blanks and '+' are skipped,
+// garbage reads as 0, out of range integers clamp, unsigned targets
+// wrap negative input, floating point prints like %g.
+// std::from_chars/to_chars for floating point need __cpp_lib_to_chars,
+// older standard libraries fall back to strtod/snprintf.
+
+namespace convert {
+
+template<class T>
+constexpr bool is_char()
+{
+	return std::is_same<T,char>::value || std::is_same<T,signed char>::value || std::is_same<T,unsigned char>::value;
+}
+
+template<class T>
+T parse(std::string_view s)
+{
+	const char* p = s.data();
+	const char* e = p + s.size();
+
+	while( p < e && isspace((unsigned char)*p) )
+	{
+		p++;
+	}
+
+	if constexpr(is_char<T>())
+	{
+		// streams read a single character into char types
+		return p < e ? (T)*p : T();
+	}
+	else if constexpr(std::is_same<T,bool>::value)
+	{
+		return parse<long long>(std::string_view(p,e-p)) != 0;
+	}
+	else if constexpr(std::is_floating_point<T>::value)
+	{
+		if( p < e && *p == '+' )
+		{
+			p++;
+		}
+
+		double v = 0;
+#ifdef __cpp_lib_to_chars
+		auto r = std::from_chars(p,e,v);
+		if( r.ec != std::errc::result_out_of_range )
+		{
+			return (T)v;
+		}
+#endif
+		// rare, needs a terminated copy
+		char tmp[64];
+		size_t n = (size_t)(e-p) < sizeof(tmp)-1 ? (size_t)(e-p) : sizeof(tmp)-1;
+		memcpy(tmp,p,n);
+		tmp[n] = 0;
+		v = strtod(tmp,nullptr);
+
+		if( std::isinf(v) )
+		{
+			return v < 0 ? std::numeric_limits<T>::lowest() : std::numeric_limits<T>::max();
+		}
+		return (T)v;
+	}
+	else
+	{
+		bool negative = p < e && *p == '-';
+		if( p < e && *p == '+' )
+		{
+			p++;
+		}
+
+		T v = 0;
+		if constexpr(std::is_unsigned<T>::value)
+		{
+			if(negative)
+			{
+				// like strtoull, -n wraps around
+				auto r = std::from_chars(p+1,e,v);
+				if( r.ec == std::errc::result_out_of_range )
+				{
+					return std::numeric_limits<T>::max();
+				}
+				return (T)(0-v);
+			}
+		}
+
+		auto r = std::from_chars(p,e,v);
+		if( r.ec == std::errc::result_out_of_range )
+		{
+			return negative ? std::numeric_limits<T>::min() : std::numeric_limits<T>::max();
+		}
+		return v;
+	}
+}
+
+// writes t into buf, returns the number of chars written. 32 chars fit every type.
+// precision is the number of significant digits of floating point values
+template<class T>
+size_t format(T t, char* buf, size_t size, int precision = 6)
+{
+	if constexpr(std::is_same<T,bool>::value)
+	{
+		buf[0] = t ? '1' : '0';
+		return 1;
+	}
+	else if constexpr(is_char<T>())
+	{
+		buf[0] = (char)t;
+		return 1;
+	}
+	else if constexpr(std::is_floating_point<T>::value)
+	{
+#ifdef __cpp_lib_to_chars
+		auto r = std::to_chars(buf,buf+size,(double)t,std::chars_format::general,precision);
+		return r.ptr - buf;
+#else
+		int n = snprintf(buf,size,"%.*g",precision,(double)t);
+		return n < 0 ? 0 : (size_t)n;
+#endif
+	}
+	else
+	{
+		auto r = std::to_chars(buf,buf+size,t);
+		return r.ptr - buf;
+	}
+}
+
+template<class T>
+std::string format(T t, int precision = 6)
+{
+	char buf[32];
+	return std::string(buf,format(t,buf,sizeof(buf),precision));
+}
+
+} // end namespace convert
+
+}
+
+#endif
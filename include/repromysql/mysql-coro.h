@@ -0,0 +1,338 @@
+#ifndef _MOL_DEF_GUARD_DEFINE_MOD_HTTP_REQUEST_MYSQL_CORO_DEF_GUARD_
+#define _MOL_DEF_GUARD_DEFINE_MOD_HTTP_REQUEST_MYSQL_CORO_DEF_GUARD_
+
+#include "repromysql/mysql-async.h"
+
+//////////////////////////////////////////////////////////////
+// co_await support for MysqlPool and mysql_async.
+// available with C++20 coroutines or the coroutines TS
+//////////////////////////////////////////////////////////////
+
+#if defined(__cpp_impl_coroutine)
+#include <coroutine>
+#define REPROMYSQL_HAS_COROUTINES
+namespace repromysql { namespace coro = std; }
+#elif defined(_RESUMABLE_FUNCTIONS_SUPPORTED) || defined(__cpp_coroutines)
+#include <experimental/coroutine>
+#define REPROMYSQL_HAS_COROUTINES
+namespace repromysql { namespace coro = std::experimental; }
+#endif
+
+#ifdef REPROMYSQL_HAS_COROUTINES
+
+namespace repromysql {
+
+//////////////////////////////////////////////////////////////
+
+// per thread free lists for coroutine frames, in 64 byte size classes.
+// frames beyond 2k and surplus free blocks go to the global heap.
+
+class frame_pool
+{
+public:
+
+	static const size_t granularity = 64;
+	static const size_t buckets = 32;
+	static const size_t max_free = 64;
+
+	static void* allocate(size_t n)
+	{
+		size_t b = (n + granularity - 1) / granularity;
+		if ( b == 0 || b > buckets )
+		{
+			return ::operator new(n);
+		}
+
+		lists& l = local();
+		node* p = l.head[b-1];
+		if ( p )
+		{
+			l.head[b-1] = p->next;
+			l.count[b-1]--;
+			return p;
+		}
+		return ::operator new(b*granularity);
+	}
+
+	static void release(void* p, size_t n)
+	{
+		size_t b = (n + granularity - 1) / granularity;
+		if ( b == 0 || b > buckets )
+		{
+			::operator delete(p);
+			return;
+		}
+
+		lists& l = local();
+		if ( l.count[b-1] >= max_free )
+		{
+			::operator delete(p);
+			return;
+		}
+
+		node* f = static_cast<node*>(p);
+		f->next = l.head[b-1];
+		l.head[b-1] = f;
+		l.count[b-1]++;
+	}
+
+private:
+
+	struct node
+	{
+		node* next;
+	};
+
+	struct lists
+	{
+		node* head[buckets] = {};
+		size_t count[buckets] = {};
+
+		~lists()
+		{
+			for ( size_t i = 0; i < buckets; i++)
+			{
+				while ( head[i] )
+				{
+					node* n = head[i];
+					head[i] = n->next;
+					::operator delete(n);
+				}
+			}
+		}
+	};
+
+	static lists& local()
+	{
+		thread_local lists l;
+		return l;
+	}
+};
+
+struct frame_allocated
+{
+	static void* operator new(size_t n)
+	{
+		return frame_pool::allocate(n);
+	}
+
+	static void operator delete(void* p, size_t n)
+	{
+		frame_pool::release(p,n);
+	}
+};
+
+//////////////////////////////////////////////////////////////
+
+// suspends until the future settles and resumes the coroutine 
+// directly from the resolving callback, without a nextTick hop
+
+template<class T>
+class Awaitable
+{
+public:
+
+	Awaitable(repro::Future<T> f)
+		: f_(f)
+	{}
+
+	bool await_ready() const noexcept 
+	{ 
+		return false; 
+	}
+
+	void await_suspend(coro::coroutine_handle<> h)
+	{
+		f_
+		.then( [this,h](T t)
+		{
+			value_ = t;
+			h.resume();
+		})
+		.otherwise( [this,h](const std::exception_ptr ex)
+		{
+			ex_ = ex;
+			h.resume();
+		});
+	}
+
+	T await_resume()
+	{
+		if(ex_)
+		{
+			std::rethrow_exception(ex_);
+		}
+		return std::move(value_);
+	}
+
+private:
+	repro::Future<T> f_;
+	T value_;
+	std::exception_ptr ex_;
+};
+
+template<>
+class Awaitable<void>
+{
+public:
+
+	Awaitable(repro::Future<> f)
+		: f_(f)
+	{}
+
+	bool await_ready() const noexcept 
+	{ 
+		return false; 
+	}
+
+	void await_suspend(coro::coroutine_handle<> h)
+	{
+		f_
+		.then( [h]()
+		{
+			h.resume();
+		})
+		.otherwise( [this,h](const std::exception_ptr ex)
+		{
+			ex_ = ex;
+			h.resume();
+		});
+	}
+
+	void await_resume()
+	{
+		if(ex_)
+		{
+			std::rethrow_exception(ex_);
+		}
+	}
+
+private:
+	repro::Future<> f_;
+	std::exception_ptr ex_;
+};
+
+// found by ADL for futures of repromysql types, 
+// Future<> (tx, stream) needs using namespace repromysql
+
+inline Awaitable<result_async::Ptr> operator co_await(repro::Future<result_async::Ptr> f)
+{
+	return Awaitable<result_async::Ptr>(f);
+}
+
+inline Awaitable<mysql_async::Ptr> operator co_await(repro::Future<mysql_async::Ptr> f)
+{
+	return Awaitable<mysql_async::Ptr>(f);
+}
+
+inline Awaitable<void> operator co_await(repro::Future<> f)
+{
+	return Awaitable<void>(f);
+}
+
+//////////////////////////////////////////////////////////////
+
+// coroutine return type. starts eagerly, frames come from frame_pool.
+// future() hands the outcome back to promise based code.
+
+template<class T = void>
+class Task
+{
+public:
+
+	struct promise_type : public frame_allocated
+	{
+		repro::Promise<T> p = repro::promise<T>();
+
+		Task get_return_object() 
+		{ 
+			return Task(p.future()); 
+		}
+
+		coro::suspend_never initial_suspend() noexcept { return {}; }
+		coro::suspend_never final_suspend() noexcept { return {}; }
+
+		void return_value(T t)
+		{
+			p.resolve(t);
+		}
+
+		void unhandled_exception()
+		{
+			p.reject(std::current_exception());
+		}
+	};
+
+	repro::Future<T> future() const 
+	{ 
+		return f_; 
+	}
+
+	Awaitable<T> operator co_await() const
+	{
+		return Awaitable<T>(f_);
+	}
+
+private:
+
+	Task(repro::Future<T> f)
+		: f_(f)
+	{}
+
+	repro::Future<T> f_;
+};
+
+template<>
+class Task<void>
+{
+public:
+
+	struct promise_type : public frame_allocated
+	{
+		repro::Promise<> p = repro::promise<>();
+
+		Task get_return_object() 
+		{ 
+			return Task(p.future()); 
+		}
+
+		coro::suspend_never initial_suspend() noexcept { return {}; }
+		coro::suspend_never final_suspend() noexcept { return {}; }
+
+		void return_void()
+		{
+			p.resolve();
+		}
+
+		void unhandled_exception()
+		{
+			p.reject(std::current_exception());
+		}
+	};
+
+	repro::Future<> future() const 
+	{ 
+		return f_; 
+	}
+
+	Awaitable<void> operator co_await() const
+	{
+		return Awaitable<void>(f_);
+	}
+
+private:
+
+	Task(repro::Future<> f)
+		: f_(f)
+	{}
+
+	repro::Future<> f_;
+};
+
+//////////////////////////////////////////////////////////////
+
+}
+
+#endif
+
+#endif
@@ -0,0 +1,301 @@
+#ifndef _MOL_DEF_GUARD_DEFINE_MOD_HTTP_REQUEST_MYSQL_DATETIME_DEF_GUARD_
+#define _MOL_DEF_GUARD_DEFINE_MOD_HTTP_REQUEST_MYSQL_DATETIME_DEF_GUARD_
+
+#include <mysql/mysql.h>
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+//////////////////////////////////////////////////////////////
+
+namespace repromysql {
+
+// MySQL and ISO-8601 dates and times to and from MYSQL_TIME, without
+// regex, streams or allocation. time points are taken as UTC. note a
+// system_clock with nanosecond ticks only spans the years 1678 to 2261.
+
+namespace datetime {
+
+typedef std::chrono::system_clock clock;
+
+namespace detail {
+
+// reads up to max digits, false if there is none
+inline bool digits(const char*& p, const char* e, unsigned int& v, int max)
+{
+	const char* s = p;
+	v = 0;
+	while( p < e && p-s < max && *p >= '0' && *p <= '9' )
+	{
+		v = v*10 + (*p-'0');
+		p++;
+	}
+	return p != s;
+}
+
+inline char* put(char* p, unsigned int v, int width)
+{
+	for( int i = width-1; i >= 0; i--)
+	{
+		p[i] = '0' + v%10;
+		v /= 10;
+	}
+	return p + width;
+}
+
+// days since 1970-01-01 of a proleptic gregorian date, and back.
+// http://howardhinnant.github.io/date_algorithms.html
+
+inline long long days_from_civil(long long y, unsigned int m, unsigned int d)
+{
+	y -= m <= 2;
+	const long long era = (y >= 0 ? y : y-399) / 400;
+	const unsigned int yoe = (unsigned int)(y - era * 400);
+	const unsigned int doy = (153*(m + (m > 2 ? -3 : 9)) + 2)/5 + d-1;
+	const unsigned int doe = yoe * 365 + yoe/4 - yoe/100 + doy;
+	return era * 146097 + (long long)doe - 719468;
+}
+
+inline void civil_from_days(long long z, long long& y, unsigned int& m, unsigned int& d)
+{
+	z += 719468;
+	const long long era = (z >= 0 ? z : z - 146096) / 146097;
+	const unsigned int doe = (unsigned int)(z - era * 146097);
+	const unsigned int yoe = (doe - doe/1460 + doe/36524 - doe/146096) / 365;
+	const unsigned int doy = doe - (365*yoe + yoe/4 - yoe/100);
+	const unsigned int mp = (5*doy + 2)/153;
+	d = doy - (153*mp+2)/5 + 1;
+	m = mp < 10 ? mp+3 : mp-9;
+	y = (long long)yoe + era * 400 + (m <= 2);
+}
+
+} // end namespace detail
+
+// reads "YYYY-MM-DD", "YYYY-MM-DD HH:MM:SS[.ffffff]" with ' ' or 'T'
+// between date and time, and "[-]HHH:MM:SS[.ffffff]" for TIME values.
+// trailing parts of the time may be missing, trailing text like a
+// zone designator is ignored. false if s is not a date or time, t then
+// holds what was read so far.
+
+inline bool parse(std::string_view s, MYSQL_TIME& t)
+{
+	memset(&t,0,sizeof(MYSQL_TIME));
+
+	const char* p = s.data();
+	const char* e = p + s.size();
+
+	while( p < e && *p == ' ' )
+	{
+		p++;
+	}
+
+	bool neg = p < e && *p == '-';
+	if(neg)
+	{
+		p++;
+	}
+
+	// a date has a '-' after its first digits
+	const char* q = p;
+	while( q < e && *q >= '0' && *q <= '9' )
+	{
+		q++;
+	}
+
+	if( !neg && q < e && *q == '-' )
+	{
+		t.time_type = MYSQL_TIMESTAMP_DATE;
+
+		if( !detail::digits(p,e,t.year,4) || p == e || *p++ != '-' )
+			return false;
+		if( !detail::digits(p,e,t.month,2) || p == e || *p++ != '-' )
+			return false;
+		if( !detail::digits(p,e,t.day,2) )
+			return false;
+
+		if( p == e || (*p != ' ' && *p != 'T') )
+			return true;
+		p++;
+		if( p == e || *p < '0' || *p > '9' )
+			return true;
+
+		t.time_type = MYSQL_TIMESTAMP_DATETIME;
+		if( !detail::digits(p,e,t.hour,2) )
+			return false;
+	}
+	else
+	{
+		t.time_type = MYSQL_TIMESTAMP_TIME;
+		t.neg = neg;
+		if( !detail::digits(p,e,t.hour,3) )
+			return false;
+	}
+
+	if( p == e || *p != ':' )
+		return true;
+	p++;
+	if( !detail::digits(p,e,t.minute,2) )
+		return false;
+
+	if( p == e || *p != ':' )
+		return true;
+	p++;
+	if( !detail::digits(p,e,t.second,2) )
+		return false;
+
+	if( p == e || *p != '.' )
+		return true;
+	p++;
+
+	// fraction in microseconds, extra digits are dropped
+	unsigned int us = 0;
+	int n = 0;
+	while( p < e && *p >= '0' && *p <= '9' )
+	{
+		if( n < 6 )
+		{
+			us = us*10 + (*p-'0');
+			n++;
+		}
+		p++;
+	}
+	for( ; n < 6; n++)
+	{
+		us *= 10;
+	}
+	t.second_part = us;
+	return true;
+}
+
+// writes t like MySQL prints the given column type, microseconds only
+// if there are any. returns the length, 32 chars fit every value.
+
+inline size_t format(const MYSQL_TIME& t, enum_field_types type, char* buf)
+{
+	char* p = buf;
+
+	if( type != MYSQL_TYPE_TIME )
+	{
+		p = detail::put(p, t.year, 4);
+		*p++ = '-';
+		p = detail::put(p, t.month, 2);
+		*p++ = '-';
+		p = detail::put(p, t.day, 2);
+
+		if( type == MYSQL_TYPE_DATE )
+		{
+			return p - buf;
+		}
+		*p++ = ' ';
+		p = detail::put(p, t.hour, 2);
+	}
+	else
+	{
+		if(t.neg)
+		{
+			*p++ = '-';
+		}
+		p = detail::put(p, t.hour, t.hour > 99 ? 3 : 2);
+	}
+
+	*p++ = ':';
+	p = detail::put(p, t.minute, 2);
+	*p++ = ':';
+	p = detail::put(p, t.second, 2);
+
+	if( t.second_part )
+	{
+		*p++ = '.';
+		p = detail::put(p, (unsigned int)t.second_part, 6);
+	}
+	return p - buf;
+}
+
+inline std::string format(const MYSQL_TIME& t, enum_field_types type)
+{
+	char buf[32];
+	return std::string(buf,format(t,type,buf));
+}
+
+// UTC calendar time of tp, to the microsecond
+
+inline MYSQL_TIME from_time_point(clock::time_point tp)
+{
+	using namespace std::chrono;
+
+	MYSQL_TIME t;
+	memset(&t,0,sizeof(MYSQL_TIME));
+	t.time_type = MYSQL_TIMESTAMP_DATETIME;
+
+	auto us = time_point_cast<microseconds>(tp).time_since_epoch();
+	auto d = floor<duration<long long,std::ratio<86400>>>(us);
+	auto rest = us - d;
+
+	long long y;
+	detail::civil_from_days(d.count(), y, t.month, t.day);
+	t.year = (unsigned int)y;
+
+	auto s = duration_cast<seconds>(rest);
+	t.hour = (unsigned int)(s.count() / 3600);
+	t.minute = (unsigned int)(s.count() / 60 % 60);
+	t.second = (unsigned int)(s.count() % 60);
+	t.second_part = (unsigned long)(rest - s).count();
+	return t;
+}
+
+// microseconds since the epoch of t read as UTC, for TIME values
+// the signed time of day. covers every year MySQL does
+
+inline long long micros(const MYSQL_TIME& t)
+{
+	long long days = 0;
+	if( t.time_type != MYSQL_TIMESTAMP_TIME && t.month && t.day )
+	{
+		days = detail::days_from_civil(t.year, t.month, t.day);
+	}
+
+	long long us = (days*86400LL + t.hour*3600LL + t.minute*60LL + t.second) * 1000000LL + (long long)t.second_part;
+	if( t.time_type == MYSQL_TIMESTAMP_TIME && t.neg )
+	{
+		us = -us;
+	}
+	return us;
+}
+
+inline clock::time_point to_time_point(const MYSQL_TIME& t)
+{
+	using namespace std::chrono;
+
+	return clock::time_point( duration_cast<clock::duration>( microseconds(micros(t)) ) );
+}
+
+#if __cpp_lib_chrono >= 201907L
+
+inline MYSQL_TIME from_date(std::chrono::year_month_day ymd)
+{
+	MYSQL_TIME t;
+	memset(&t,0,sizeof(MYSQL_TIME));
+	t.time_type = MYSQL_TIMESTAMP_DATE;
+	t.year = (int)ymd.year();
+	t.month = (unsigned int)ymd.month();
+	t.day = (unsigned int)ymd.day();
+	return t;
+}
+
+inline std::chrono::year_month_day to_date(const MYSQL_TIME& t)
+{
+	return std::chrono::year_month_day(
+		std::chrono::year((int)t.year),
+		std::chrono::month(t.month),
+		std::chrono::day(t.day)
+	);
+}
+
+#endif
+
+} // end namespace datetime
+
+}
+
+#endif
@@ -0,0 +1,94 @@
+#ifndef _MOL_DEF_GUARD_DEFINE_MOD_HTTP_REQUEST_MYSQL_DIGEST_DEF_GUARD_
+#define _MOL_DEF_GUARD_DEFINE_MOD_HTTP_REQUEST_MYSQL_DIGEST_DEF_GUARD_
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+//////////////////////////////////////////////////////////////
+
+namespace repromysql {
+
+// aggregated statistics of one statement shape, as returned by DigestStats::dump
+
+struct Digest
+{
+	uint64_t id = 0;
+	std::string text;
+
+	unsigned long long calls = 0;
+	unsigned long long errors = 0;
+	unsigned long long rows = 0;
+
+	// seconds, p99 is the upper bound of its log2 histogram bucket
+	double total = 0;
+	double min = 0;
+	double max = 0;
+	double p99 = 0;
+};
+
+// per statement shape statistics. SQL is normalized into a fingerprint:
+// literals become ?, whitespace and comments collapse, lists of ? and 
+// repeated (?) groups fold into one. the table is split into shards 
+// with a mutex each, so workers rarely contend.
+
+class DigestStats
+{
+public:
+	typedef std::shared_ptr<DigestStats> Ptr;
+	typedef std::chrono::steady_clock clock;
+
+	static const size_t shards = 16;
+	static const size_t buckets = 32;
+
+	// statements beyond max_digests are counted under id 0
+	DigestStats(size_t max_digests = 5000);
+
+	static std::string normalize(const std::string& sql);
+
+	// never 0
+	static uint64_t fingerprint(const std::string& sql);
+
+	// id is fingerprint(sql), sql is only normalized again for a new digest
+	void record(uint64_t id, const std::string& sql, clock::duration d, long long rows, bool error);
+
+	std::vector<Digest> dump(bool reset = false);
+	void reset();
+
+private:
+
+	DigestStats(const DigestStats& rhs) = delete;
+	DigestStats& operator=(const DigestStats& rhs) = delete;
+
+	struct Entry
+	{
+		std::string text;
+		unsigned long long calls = 0;
+		unsigned long long errors = 0;
+		unsigned long long rows = 0;
+		clock::duration total = clock::duration::zero();
+		clock::duration min = clock::duration::max();
+		clock::duration max = clock::duration::zero();
+		unsigned long long histogram[buckets] = {};
+	};
+
+	struct Shard
+	{
+		std::mutex mutex;
+		std::unordered_map<uint64_t,Entry> map;
+	};
+
+	static void add(Entry& e, clock::duration d, long long rows, bool error, size_t bucket);
+
+	Shard shards_[shards];
+	Shard overflow_; // digest 0, statements beyond max_digests
+	size_t max_per_shard_;
+};
+
+}
+
+#endif
@@ -0,0 +1,165 @@
+#ifndef _MOL_DEF_GUARD_DEFINE_MOD_HTTP_REQUEST_MYSQL_POOL_DEF_GUARD_
+#define _MOL_DEF_GUARD_DEFINE_MOD_HTTP_REQUEST_MYSQL_POOL_DEF_GUARD_
+
+#include "repromysql/mysql-api.h"
+#include "priocpp/api.h"
+#include "priocpp/task.h"
+#include <chrono>
+#include <list>
+#include <mutex>
+#include <random>
+
+//////////////////////////////////////////////////////////////
+
+namespace repromysql {
+
+// point in time copy of the pool counters
+
+struct PoolStats
+{
+	// acquire wait histogram, bucket i counts waits up to 2^i microseconds,
+	// the last bucket everything above
+	static const size_t buckets = 26;
+
+	size_t capacity = 0;
+	size_t total = 0;
+	size_t in_use = 0;
+	size_t idle = 0;
+	size_t opening = 0;
+	size_t waiting = 0;
+
+	unsigned long long acquired = 0;
+	unsigned long long created = 0;
+	unsigned long long destroyed = 0;
+	unsigned long long invalidated = 0;
+	unsigned long long failed = 0;
+
+	unsigned long long wait[buckets] = {};
+	double wait_total = 0; // seconds
+
+	// upper bound of bucket i in microseconds
+	static double bound(size_t i);
+
+	// approximate acquire wait in microseconds for percentile p in [0,1]
+	double wait_percentile(double p) const;
+};
+
+// connection pool with the surface of prio::Resource::Pool,
+// keeping track of idle connections so it can maintain them.
+// connections are opened via MysqlLocator::retrieve and
+// closed via MysqlLocator::free.
+
+class ConnectionPool : public std::enable_shared_from_this<ConnectionPool>
+{
+public:
+	typedef std::shared_ptr<ConnectionPool> Ptr;
+	typedef std::shared_ptr<MYSQL> ResourcePtr;
+	typedef std::chrono::steady_clock clock;
+
+	ConnectionPool(const std::string& url, size_t capacity);
+	~ConnectionPool();
+
+	ConnectionPool(const ConnectionPool& rhs) = delete;
+	ConnectionPool& operator=(const ConnectionPool& rhs) = delete;
+
+	// borrowed connections return to the pool when the last
+	// reference is dropped
+	repro::Future<ResourcePtr> get();
+
+	void shutdown();
+
+	size_t capacity() const { return capacity_; }
+	size_t min_idle() const { return min_idle_; }
+
+	// opens connections concurrently until n are idle and keeps 
+	// that floor in the background. resolves once the pool is warm
+	repro::Future<> prewarm(size_t n);
+
+	// housekeeping runs once a second on the event loop, 0 disables.
+	// pings connections idle for longer than secs 
+	void keepalive(int secs);
+
+	// closes connections idle for longer than secs, down to min_idle
+	void idle_timeout(int secs);
+
+	// recycles connections older than secs, minus up to 10% jitter
+	// per connection so they do not all expire at once
+	void max_lifetime(int secs);
+
+	PoolStats stats() const;
+
+	// the connection gets closed instead of pooled on release
+	static void invalidate(ResourcePtr& r);
+
+private:
+
+	struct Connection
+	{
+		MYSQL* con;
+		clock::time_point created;
+		clock::time_point returned;
+		clock::time_point checked;
+		bool invalid;
+		double jitter;
+	};
+
+	typedef std::shared_ptr<Connection> ConnectionPtr;
+	struct Waiter
+	{
+		repro::Promise<ResourcePtr> p;
+		clock::time_point since;
+	};
+
+	typedef std::list<Waiter> Waiters;
+
+	struct Releaser;
+
+	ResourcePtr wrap(ConnectionPtr c, clock::time_point since);
+	ConnectionPtr track(MYSQL* m);
+
+	void open(repro::Promise<ResourcePtr> p, clock::time_point since);
+	repro::Future<> spawn();
+	void release(ConnectionPtr c);
+	void hand_off(ConnectionPtr c, bool used = true);
+	void dropped();
+	void fill();
+	void retry();
+	void schedule();
+	void housekeeping();
+	void ping(ConnectionPtr c);
+	bool expired(const ConnectionPtr& c, clock::time_point now) const;
+	void close(ConnectionPtr c);
+
+	std::string url_;
+	size_t capacity_;
+	size_t min_idle_;
+	size_t total_;
+	size_t filling_;
+	size_t pinging_;
+	bool shutdown_;
+	bool retrying_;
+	bool scheduled_;
+
+	clock::duration keepalive_;
+	clock::duration idle_timeout_;
+	clock::duration max_lifetime_;
+
+	std::minstd_rand random_;
+
+	size_t borrowed_;
+	unsigned long long acquired_;
+	unsigned long long created_;
+	unsigned long long destroyed_;
+	unsigned long long invalidated_;
+	unsigned long long failed_;
+	unsigned long long wait_[PoolStats::buckets];
+	clock::duration wait_total_;
+
+	std::list<ConnectionPtr> idle_;
+	Waiters waiters_;
+	mutable std::mutex mutex_;
+};
+
+}
+
+#endif
@@ -0,0 +1,293 @@
+#ifndef _MOL_DEF_GUARD_DEFINE_MOD_HTTP_REQUEST_MYSQL_ROUTING_DEF_GUARD_
+#define _MOL_DEF_GUARD_DEFINE_MOD_HTTP_REQUEST_MYSQL_ROUTING_DEF_GUARD_
+
+#include "repromysql/mysql-async.h"
+
+//////////////////////////////////////////////////////////////
+
+namespace repromysql {
+
+// one primary and N replica pools behind the MysqlPool interface.
+// query() and stream() read from a replica, execute(), bulk() and tx()
+// write to the primary. every call takes an optional Route to override.
+// replicas are picked on the event loop thread; a replica that fails
+// to connect is skipped for a while and reads fall back to the primary when no
+// replica is left.
+
+class RoutingMysqlPool
+{
+public:
+
+	enum Route { AUTO, PRIMARY, REPLICA };
+
+	// LEAST_OUTSTANDING picks the replica with the fewest calls in flight,
+	// EWMA the lowest latency average weighted by calls in flight
+	enum Policy { LEAST_OUTSTANDING, EWMA };
+
+	// read-your-writes for one logical session, e.g. one user. tx() on
+	// a session remembers the GTID of its commit, later reads on the 
+	// session wait for a replica to apply it or go to the primary.
+	// only the latest GTID is kept, which relies on replicas preserving
+	// commit order.
+
+	class Session
+	{
+	public:
+		typedef std::shared_ptr<Session> Ptr;
+
+		const std::string& gtid() const { return gtid_; }
+		void gtid(const std::string& g) { gtid_ = g; }
+
+	private:
+		std::string gtid_;
+	};
+
+	Session::Ptr session() { return std::make_shared<Session>(); }
+
+	RoutingMysqlPool(
+		const std::string& primary,
+		const std::vector<std::string>& replicas,
+		int capacity = 4,
+		MysqlPool::Mode mode = MysqlPool::THREADED
+	);
+
+	Policy policy() const { return policy_; }
+	void policy(Policy p) { policy_ = p; }
+
+	// seconds a failed replica is skipped
+	void backoff(int secs) { backoff_ = std::chrono::seconds(secs); }
+
+	// how long a session read waits for a replica to catch up 
+	// before it is sent to the primary
+	void consistency_timeout(int ms) { wait_ = ms; }
+
+	template<class ...Args>
+	repro::Future<std::shared_ptr<result_async>> query(std::string sql, Args ... args)
+	{
+		return query(AUTO, sql, args...);
+	}
+
+	template<class ...Args>
+	repro::Future<std::shared_ptr<result_async>> query(Route r, std::string sql, Args ... args)
+	{
+		auto replica = read(r);
+		if(!replica)
+		{
+			return primary_.query(sql,args...);
+		}
+		return track(replica, replica->pool.query(sql,args...));
+	}
+
+	template<class ...Args>
+	repro::Future<std::shared_ptr<result_async>> query(Session::Ptr session, std::string sql, Args ... args)
+	{
+		auto replica = pick();
+		if(!replica)
+		{
+			return primary_.query(sql,args...);
+		}
+		if(session->gtid().empty())
+		{
+			return track(replica, replica->pool.query(sql,args...));
+		}
+
+		auto p = repro::promise<std::shared_ptr<result_async>>();
+		MysqlPool primary = primary_;
+
+		caught_up(replica,session->gtid())
+		.then( [primary,replica,sql,args...](mysql_async::Ptr m) mutable
+		{
+			if(!m)
+			{
+				replica->fallbacks++;
+				return primary.query(sql,args...);
+			}
+			return m->query(sql,args...);
+		})
+		.then( [p](std::shared_ptr<result_async> r)
+		{
+			p.resolve(r);
+		})
+		.otherwise(reject(p));
+
+		// time spent waiting for the replica counts towards its latency
+		return track(replica, p.future());
+	}
+
+	template<class ...Args>
+	repro::Future<std::shared_ptr<mysql_async>> execute(std::string sql, Args ... args)
+	{
+		return execute(AUTO, sql, args...);
+	}
+
+	template<class ...Args>
+	repro::Future<std::shared_ptr<mysql_async>> execute(Route r, std::string sql, Args ... args)
+	{
+		auto replica = write(r);
+		if(!replica)
+		{
+			return primary_.execute(sql,args...);
+		}
+		return track(replica, replica->pool.execute(sql,args...));
+	}
+
+	template<class ... T>
+	repro::Future<std::shared_ptr<mysql_async>> bulk(std::string sql, std::vector<std::tuple<T...>> rows)
+	{
+		return primary_.bulk(sql,rows);
+	}
+
+	template<class F, class ...Args>
+	repro::Future<> stream(std::string sql, size_t batch, F consumer, Args ... args)
+	{
+		return stream(AUTO, sql, batch, consumer, args...);
+	}
+
+	template<class F, class ...Args>
+	repro::Future<> stream(Route r, std::string sql, size_t batch, F consumer, Args ... args)
+	{
+		auto replica = read(r);
+		if(!replica)
+		{
+			return primary_.stream(sql,batch,consumer,args...);
+		}
+		return track(replica, replica->pool.stream(sql,batch,consumer,args...));
+	}
+
+	template<class F>
+	repro::Future<> tx( F fun )
+	{
+		return primary_.tx(fun);
+	}
+
+	template<class F>
+	repro::Future<> tx( Session::Ptr session, F fun )
+	{
+		auto p = repro::promise<>();
+
+		primary_.tx_gtid(fun)
+		.then( [p,session](std::string gtid)
+		{
+			if(!gtid.empty())
+			{
+				session->gtid(gtid);
+			}
+			p.resolve();
+		})
+		.otherwise(reject(p));
+
+		return p.future();
+	}
+
+	// a connection for callers that need one, from the primary unless routed
+	repro::Future<std::shared_ptr<mysql_async>> con(Route r = PRIMARY);
+
+	MysqlPool& primary() { return primary_; }
+	MysqlPool& replica(size_t i) { return replicas_[i]->pool; }
+	size_t replicas() const { return replicas_.size(); }
+
+	// calls in flight and latency average in seconds, per replica
+	size_t outstanding(size_t i) const { return replicas_[i]->outstanding; }
+	double latency(size_t i) const { return replicas_[i]->ewma; }
+
+	// session reads that went to the primary because the replica lagged
+	size_t fallbacks(size_t i) const { return replicas_[i]->fallbacks; }
+
+	// configure primary and replicas alike
+	repro::Future<> prewarm(size_t min_idle);
+	void keepalive(int secs);
+	void idle_timeout(int secs);
+	void max_lifetime(int secs);
+	void hook(QueryHook::Ptr h);
+	void slow_log(std::shared_ptr<SlowQueryLog> log);
+	void digests(DigestStats::Ptr d);
+	void statement_cache(size_t n);
+	void shutdown();
+
+private:
+
+	typedef std::chrono::steady_clock clock;
+
+	struct Replica
+	{
+		Replica(const std::string& url, int capacity, MysqlPool::Mode mode)
+			: pool(url,capacity,mode)
+		{}
+
+		MysqlPool pool;
+		size_t outstanding = 0;
+		double ewma = 0;
+		unsigned long long connect_failures = 0;
+		size_t fallbacks = 0;
+		clock::time_point down_until;
+	};
+
+	typedef std::shared_ptr<Replica> ReplicaPtr;
+
+	ReplicaPtr read(Route r);
+	ReplicaPtr write(Route r);
+	ReplicaPtr pick();
+
+	// a replica connection once gtid is applied there, 
+	// nullptr on timeout or when the replica cannot tell
+	repro::Future<mysql_async::Ptr> caught_up(ReplicaPtr replica, const std::string& gtid);
+
+	static void done(ReplicaPtr replica, clock::time_point start);
+
+	// only connect failures take a replica out, statement errors do not
+	static void failed(ReplicaPtr replica, clock::duration backoff);
+
+	template<class T>
+	repro::Future<T> track(ReplicaPtr replica, repro::Future<T> f)
+	{
+		auto p = repro::promise<T>();
+		auto start = clock::now();
+		auto backoff = backoff_;
+		replica->outstanding++;
+
+		f.then( [p,replica,start](T t)
+		{
+			done(replica,start);
+			p.resolve(t);
+		})
+		.otherwise( [p,replica,backoff](const std::exception_ptr ex)
+		{
+			failed(replica,backoff);
+			p.reject(ex);
+		});
+
+		return p.future();
+	}
+
+	repro::Future<> track(ReplicaPtr replica, repro::Future<> f)
+	{
+		auto p = repro::promise<>();
+		auto start = clock::now();
+		auto backoff = backoff_;
+		replica->outstanding++;
+
+		f.then( [p,replica,start]()
+		{
+			done(replica,start);
+			p.resolve();
+		})
+		.otherwise( [p,replica,backoff](const std::exception_ptr ex)
+		{
+			failed(replica,backoff);
+			p.reject(ex);
+		});
+
+		return p.future();
+	}
+
+	MysqlPool primary_;
+	std::vector<ReplicaPtr> replicas_;
+	Policy policy_;
+	clock::duration backoff_;
+	int wait_;
+	size_t next_;
+};
+
+}
+
+#endif
@@ -0,0 +1,385 @@
+#ifndef _MOL_DEF_GUARD_DEFINE_MOD_HTTP_REQUEST_MYSQL_ROWS_DEF_GUARD_
+#define _MOL_DEF_GUARD_DEFINE_MOD_HTTP_REQUEST_MYSQL_ROWS_DEF_GUARD_
+
+#include "repromysql/mysql-bindings.h"
+#include <cstring>
+#include <optional>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+//////////////////////////////////////////////////////////////
+
+namespace repromysql {
+
+// maps an aggregate onto result columns, in column order, for result_async::as:
+//
+// template<> struct row_members<User>
+// {
+//     static auto get() { return std::make_tuple(&User::id, &User::name); }
+// };
+
+template<class T>
+struct row_members;
+
+// compile time typed columns. every C++ target type knows how to bind
+// itself as a MYSQL_BIND, so the client library converts straight into
+// the target and rows come back without a per cell switch.
+
+namespace typed {
+
+inline bool numeric(enum_field_types t)
+{
+	switch(t)
+	{
+		case MYSQL_TYPE_TINY:
+		case MYSQL_TYPE_SHORT:
+		case MYSQL_TYPE_LONG:
+		case MYSQL_TYPE_INT24:
+		case MYSQL_TYPE_LONGLONG:
+		case MYSQL_TYPE_FLOAT:
+		case MYSQL_TYPE_DOUBLE:
+		case MYSQL_TYPE_DECIMAL:
+		case MYSQL_TYPE_NEWDECIMAL:
+		case MYSQL_TYPE_YEAR:
+		case MYSQL_TYPE_BIT:
+		case MYSQL_TYPE_NULL:
+		{
+			return true;
+		}
+		default :
+		{
+			return false;
+		}
+	}
+}
+
+inline bool temporal(enum_field_types t)
+{
+	switch(t)
+	{
+		case MYSQL_TYPE_DATE:
+		case MYSQL_TYPE_TIME:
+		case MYSQL_TYPE_DATETIME:
+		case MYSQL_TYPE_TIMESTAMP:
+		case MYSQL_TYPE_NULL:
+		{
+			return true;
+		}
+		default :
+		{
+			return false;
+		}
+	}
+}
+
+inline void mismatch(const MYSQL_FIELD& f, int i, const char* target)
+{
+	std::string msg = "column ";
+	msg += std::to_string(i) + " (" + (f.name ? f.name : "") + ") cannot be read as " + target;
+	throw repro::Ex(msg);
+}
+
+// buffer type the client library converts into
+
+template<class T> struct sql_type;
+template<> struct sql_type<signed char> { static const enum_field_types value = MYSQL_TYPE_TINY; };
+template<> struct sql_type<unsigned char> { static const enum_field_types value = MYSQL_TYPE_TINY; };
+template<> struct sql_type<short> { static const enum_field_types value = MYSQL_TYPE_SHORT; };
+template<> struct sql_type<unsigned short> { static const enum_field_types value = MYSQL_TYPE_SHORT; };
+template<> struct sql_type<int> { static const enum_field_types value = MYSQL_TYPE_LONG; };
+template<> struct sql_type<unsigned int> { static const enum_field_types value = MYSQL_TYPE_LONG; };
+template<> struct sql_type<long> { static const enum_field_types value = sizeof(long) == 8 ? MYSQL_TYPE_LONGLONG : MYSQL_TYPE_LONG; };
+template<> struct sql_type<unsigned long> { static const enum_field_types value = sizeof(long) == 8 ? MYSQL_TYPE_LONGLONG : MYSQL_TYPE_LONG; };
+template<> struct sql_type<long long> { static const enum_field_types value = MYSQL_TYPE_LONGLONG; };
+template<> struct sql_type<unsigned long long> { static const enum_field_types value = MYSQL_TYPE_LONGLONG; };
+template<> struct sql_type<float> { static const enum_field_types value = MYSQL_TYPE_FLOAT; };
+template<> struct sql_type<double> { static const enum_field_types value = MYSQL_TYPE_DOUBLE; };
+
+template<class T, class Enable = void>
+struct column;
+
+// numbers
+
+template<class T>
+struct column<T, typename std::enable_if<std::is_arithmetic<T>::value && !std::is_same<T,bool>::value>::type>
+{
+	mybool is_null = 0;
+	mybool error = 0;
+	unsigned long length = 0;
+
+	static void check(const MYSQL_FIELD& f, int i)
+	{
+		if(!numeric(f.type)) mismatch(f,i,"a number");
+	}
+
+	void bind(MYSQL_BIND& b, T& t)
+	{
+		b.buffer_type = sql_type<T>::value;
+		b.buffer = &t;
+		b.buffer_length = sizeof(T);
+		b.is_unsigned = std::is_unsigned<T>::value;
+		b.is_null = &is_null;
+		b.error = &error;
+		b.length = &length;
+	}
+
+	void load(MYSQL_STMT* , MYSQL_BIND& , unsigned int i, T& t)
+	{
+		// the value did not fit, say a BIGINT or DOUBLE read into an int
+		if(error && !is_null) throw repro::Ex("column " + std::to_string(i) + " was truncated");
+		if(is_null) t = T();
+	}
+
+	static void parse(const char* s, unsigned long len, T& t)
+	{
+		if(!s)
+		{
+			t = T();
+			return;
+		}
+		t = convert::parse<T>(std::string_view(s,len));
+	}
+};
+
+// strings, sized from the column and completed on truncation
+
+template<>
+struct column<std::string>
+{
+	mybool is_null = 0;
+	mybool error = 0;
+	unsigned long length = 0;
+	std::vector<char> buf;
+
+	static void check(const MYSQL_FIELD& , int )
+	{
+		// the client library renders any type as a string
+	}
+
+	void size(unsigned long n)
+	{
+		// long text columns declare up to 4GB. longer values than the
+		// buffer are read with mysql_stmt_fetch_column in load()
+		const unsigned long max = 64*1024;
+		buf.resize( n == 0 ? 1 : (n > max ? max : n+1) );
+	}
+
+	void bind(MYSQL_BIND& b, std::string& )
+	{
+		b.buffer_type = MYSQL_TYPE_STRING;
+		b.buffer = buf.data();
+		b.buffer_length = buf.size();
+		b.is_null = &is_null;
+		b.error = &error;
+		b.length = &length;
+	}
+
+	void load(MYSQL_STMT* st, MYSQL_BIND& b, unsigned int i, std::string& t)
+	{
+		if(is_null)
+		{
+			t.clear();
+			return;
+		}
+		if(length <= buf.size())
+		{
+			t.assign(buf.data(),length);
+			return;
+		}
+
+		// truncated, fetch the whole value straight into the target
+		t.resize(length);
+		MYSQL_BIND full;
+		memset(&full,0,sizeof(MYSQL_BIND));
+		full.buffer_type = MYSQL_TYPE_STRING;
+		full.buffer = &t[0];
+		full.buffer_length = length;
+		if(mysql_stmt_fetch_column(st,&full,i,0))
+		{
+			throw repro::Ex("mysql_stmt_fetch_column failed");
+		}
+	}
+
+	static void parse(const char* s, unsigned long len, std::string& t)
+	{
+		if(!s)
+		{
+			t.clear();
+			return;
+		}
+		t.assign(s,len);
+	}
+};
+
+// dates and times
+
+template<>
+struct column<MYSQL_TIME>
+{
+	mybool is_null = 0;
+	mybool error = 0;
+	unsigned long length = 0;
+
+	static void check(const MYSQL_FIELD& f, int i)
+	{
+		if(!temporal(f.type)) mismatch(f,i,"MYSQL_TIME");
+	}
+
+	void bind(MYSQL_BIND& b, MYSQL_TIME& t)
+	{
+		b.buffer_type = MYSQL_TYPE_DATETIME;
+		b.buffer = &t;
+		b.buffer_length = sizeof(MYSQL_TIME);
+		b.is_null = &is_null;
+		b.error = &error;
+		b.length = &length;
+	}
+
+	void load(MYSQL_STMT* , MYSQL_BIND& , unsigned int , MYSQL_TIME& t)
+	{
+		if(is_null) memset(&t,0,sizeof(MYSQL_TIME));
+	}
+
+	static void parse(const char* s, unsigned long len, MYSQL_TIME& t)
+	{
+		memset(&t,0,sizeof(MYSQL_TIME));
+		if(!s)
+		{
+			return;
+		}
+		datetime::parse(std::string_view(s,len),t);
+	}
+};
+
+// UTC time points, bound as MYSQL_TIME
+
+template<>
+struct column<datetime::clock::time_point>
+{
+	column<MYSQL_TIME> inner;
+	MYSQL_TIME value;
+
+	static void check(const MYSQL_FIELD& f, int i)
+	{
+		if(!temporal(f.type)) mismatch(f,i,"a time point");
+	}
+
+	void bind(MYSQL_BIND& b, datetime::clock::time_point& )
+	{
+		inner.bind(b,value);
+	}
+
+	void load(MYSQL_STMT* , MYSQL_BIND& , unsigned int , datetime::clock::time_point& t)
+	{
+		t = inner.is_null ? datetime::clock::time_point() : datetime::to_time_point(value);
+	}
+
+	static void parse(const char* s, unsigned long len, datetime::clock::time_point& t)
+	{
+		MYSQL_TIME v;
+		column<MYSQL_TIME>::parse(s,len,v);
+		t = s ? datetime::to_time_point(v) : datetime::clock::time_point();
+	}
+};
+
+// nullable columns
+
+template<class T>
+struct column<std::optional<T>>
+{
+	column<T> inner;
+	T value = T();
+
+	static void check(const MYSQL_FIELD& f, int i)
+	{
+		column<T>::check(f,i);
+	}
+
+	void size(unsigned long n)
+	{
+		if constexpr(std::is_same<T,std::string>::value) inner.size(n);
+	}
+
+	void bind(MYSQL_BIND& b, std::optional<T>& )
+	{
+		inner.bind(b,value);
+	}
+
+	void load(MYSQL_STMT* st, MYSQL_BIND& b, unsigned int i, std::optional<T>& t)
+	{
+		if(inner.is_null)
+		{
+			t.reset();
+			return;
+		}
+		inner.load(st,b,i,value);
+		t = value;
+	}
+
+	static void parse(const char* s, unsigned long len, std::optional<T>& t)
+	{
+		if(!s)
+		{
+			t.reset();
+			return;
+		}
+		T v;
+		column<T>::parse(s,len,v);
+		t = std::move(v);
+	}
+};
+
+// references to the members of one row object
+
+template<class ... T>
+std::tuple<T&...> members(std::tuple<T...>& row)
+{
+	return std::apply( [](T& ... t) { return std::tie(t...); }, row);
+}
+
+template<class R>
+auto members(R& row)
+{
+	return std::apply( [&row](auto ... m) { return std::tie( (row.*m)... ); }, row_members<R>::get() );
+}
+
+template<class Refs>
+struct columns_of;
+
+template<class ... T>
+struct columns_of<std::tuple<T&...>>
+{
+	typedef std::tuple<column<T>...> type;
+};
+
+template<class C>
+auto sizer(C& c, unsigned long n, int) -> decltype(c.size(n), void())
+{
+	c.size(n);
+}
+
+template<class C>
+void sizer(C& , unsigned long , long)
+{}
+
+// F is called with the index, the column state and the target reference
+
+template<class Columns, class Refs, class F, size_t ... I>
+void each(Columns& columns, Refs& refs, F f, std::index_sequence<I...>)
+{
+	int unused[] = { 0, (f( (unsigned int)I, std::get<I>(columns), std::get<I>(refs) ),0)... };
+	(void)unused;
+}
+
+template<class Columns, class Refs, class F>
+void each(Columns& columns, Refs& refs, F f)
+{
+	each(columns, refs, f, std::make_index_sequence<std::tuple_size<Columns>::value>());
+}
+
+} // end namespace typed
+
+}
+
+#endif
@@ -0,0 +1,159 @@
+#ifndef _MOL_DEF_GUARD_DEFINE_MOD_HTTP_REQUEST_MYSQL_SHARDING_DEF_GUARD_
+#define _MOL_DEF_GUARD_DEFINE_MOD_HTTP_REQUEST_MYSQL_SHARDING_DEF_GUARD_
+
+#include "repromysql/mysql-async.h"
+#include <type_traits>
+
+//////////////////////////////////////////////////////////////
+
+namespace repromysql {
+
+// consistent hash ring with virtual nodes. shards are placed by their
+// url, so adding or removing a shard only moves the keys next to it
+
+class HashRing
+{
+public:
+
+	HashRing(const std::vector<std::string>& nodes, size_t vnodes);
+
+	size_t lookup(const std::string& key) const;
+
+	static uint64_t hash(const std::string& s);
+
+private:
+
+	// sorted by hash, second is the node index
+	std::vector<std::pair<uint64_t,size_t>> ring_;
+};
+
+// one MysqlPool per shard, calls are routed by the hash of a key.
+// the key extractor maps the given key to the part that gets hashed,
+// e.g. the tenant of a "tenant:user" key. scatter() runs a query on
+// every shard in parallel and merges the rows.
+
+class ShardedMysqlPool
+{
+public:
+
+	typedef std::function<std::string(const std::string&)> KeyExtractor;
+
+	ShardedMysqlPool(
+		const std::vector<std::string>& urls,
+		int capacity = 4,
+		MysqlPool::Mode mode = MysqlPool::THREADED,
+		size_t vnodes = 160
+	);
+
+	ShardedMysqlPool(
+		const std::vector<std::string>& urls,
+		KeyExtractor extractor,
+		int capacity = 4,
+		MysqlPool::Mode mode = MysqlPool::THREADED,
+		size_t vnodes = 160
+	);
+
+	template<class K>
+	size_t shard_index(const K& key) const
+	{
+		return ring_.lookup( extractor_(to_key(key)) );
+	}
+
+	template<class K>
+	MysqlPool& shard(const K& key)
+	{
+		return shards_[shard_index(key)];
+	}
+
+	MysqlPool& shard_at(size_t i) { return shards_[i]; }
+	size_t shards() const { return shards_.size(); }
+
+	template<class K, class ...Args>
+	repro::Future<std::shared_ptr<result_async>> query(const K& key, std::string sql, Args ... args)
+	{
+		return shard(key).query(sql,args...);
+	}
+
+	template<class K, class ...Args>
+	repro::Future<std::shared_ptr<mysql_async>> execute(const K& key, std::string sql, Args ... args)
+	{
+		return shard(key).execute(sql,args...);
+	}
+
+	template<class K, class F, class ...Args>
+	repro::Future<> stream(const K& key, std::string sql, size_t batch, F consumer, Args ... args)
+	{
+		return shard(key).stream(sql,batch,consumer,args...);
+	}
+
+	template<class K, class F>
+	repro::Future<> tx( const K& key, F fun )
+	{
+		return shard(key).tx(fun);
+	}
+
+	// runs sql on all shards in parallel. rows are copied out as each
+	// shard answers, in completion order, so connections go back early.
+	// rejects with the first failure.
+	template<class ...Args>
+	repro::Future<result_batch::Ptr> scatter(std::string sql, Args ... args)
+	{
+		auto p = repro::promise<result_batch::Ptr>();
+		auto gather = std::make_shared<Gather>(shards_.size());
+
+		for( auto& pool : shards_)
+		{
+			pool.query(sql,args...)
+			.then( [p,gather](result_async::Ptr r)
+			{
+				gather->add(p,r);
+			})
+			.otherwise( [p,gather](const std::exception_ptr ex)
+			{
+				gather->fail(p,ex);
+			});
+		}
+
+		return p.future();
+	}
+
+	// configure all shards alike
+	repro::Future<> prewarm(size_t min_idle);
+	void keepalive(int secs);
+	void idle_timeout(int secs);
+	void max_lifetime(int secs);
+	void hook(QueryHook::Ptr h);
+	void slow_log(std::shared_ptr<SlowQueryLog> log);
+	void digests(DigestStats::Ptr d);
+	void statement_cache(size_t n);
+	void shutdown();
+
+private:
+
+	// collects scatter results on the event loop thread
+	struct Gather
+	{
+		Gather(size_t n) : pending(n), failed(false) {}
+
+		void add(repro::Promise<result_batch::Ptr> p, result_async::Ptr r);
+		void fail(repro::Promise<result_batch::Ptr> p, const std::exception_ptr ex);
+
+		size_t pending;
+		bool failed;
+		result_batch::Ptr batch;
+	};
+
+	static std::string to_key(const std::string& key) { return key; }
+	static std::string to_key(const char* key) { return key; }
+
+	template<class K, typename std::enable_if<std::is_arithmetic<K>::value,int>::type = 0>
+	static std::string to_key(K key) { return std::to_string(key); }
+
+	std::vector<MysqlPool> shards_;
+	HashRing ring_;
+	KeyExtractor extractor_;
+};
+
+}
+
+#endif
@@ -0,0 +1,86 @@
+#ifndef _MOL_DEF_GUARD_DEFINE_MOD_HTTP_REQUEST_MYSQL_SLOWLOG_DEF_GUARD_
+#define _MOL_DEF_GUARD_DEFINE_MOD_HTTP_REQUEST_MYSQL_SLOWLOG_DEF_GUARD_
+
+#include "repromysql/mysql-async.h"
+#include <fstream>
+
+//////////////////////////////////////////////////////////////
+
+namespace repromysql {
+
+// one statement that took longer than the slow log threshold
+
+struct SlowQuery
+{
+	std::chrono::system_clock::time_point when;
+	std::string sql;
+
+	// copies of the bound values, only their types get logged
+	std::vector<Param> params;
+
+	// rows returned or affected, -1 for unbuffered results
+	long long rows = -1;
+
+	// seconds
+	double prepare = 0;
+	double execute = 0;
+	double store = 0;
+	double total = 0;
+
+	std::string plan;
+};
+
+// client side slow query log. statements are reported from the worker
+// that ran them, handed over on the event loop and written to disk 
+// by a prio::task, so the slow request itself never waits on the log.
+
+class SlowQueryLog : public std::enable_shared_from_this<SlowQueryLog>
+{
+public:
+	typedef std::shared_ptr<SlowQueryLog> Ptr;
+	typedef std::chrono::steady_clock clock;
+
+	// appends statements taking at least threshold_ms to path
+	SlowQueryLog(const std::string& path, int threshold_ms);
+	~SlowQueryLog();
+
+	SlowQueryLog(const SlowQueryLog& rhs) = delete;
+	SlowQueryLog& operator=(const SlowQueryLog& rhs) = delete;
+
+	clock::duration threshold() const { return threshold_; }
+
+	// moves the log to path.1 .. path.keep once it grew beyond max_bytes
+	void rotate(size_t max_bytes, int keep);
+
+	// EXPLAIN slow statements on a connection borrowed from pool.
+	// one EXPLAIN runs at a time, statements slow in the meantime 
+	// are logged without a plan, as are statements EXPLAIN does 
+	// not take like COMMIT, SET or DDL
+	void explain(const MysqlPool& pool);
+
+	// called on the event loop thread
+	void record(std::shared_ptr<SlowQuery> q);
+
+private:
+
+	static std::string plan(MYSQL* con, const SlowQuery& q);
+	void write(std::shared_ptr<SlowQuery> q);
+	void append(const SlowQuery& q);
+	void rotate();
+
+	std::string path_;
+	clock::duration threshold_;
+	size_t max_bytes_;
+	int keep_;
+
+	std::weak_ptr<ConnectionPool> explain_;
+	bool explaining_;
+
+	std::mutex mutex_;
+	std::ofstream out_;
+	size_t size_;
+};
+
+}
+
+#endif
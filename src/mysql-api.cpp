@@ -19,6 +19,171 @@ MySQL::MySQL()
 }
 
 
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+// server refuses new statements beyond max_prepared_stmt_count
+#define REPROMYSQL_ER_MAX_PREPARED_STMT_COUNT_REACHED 1461
+
+StatementCache::Entry::Entry(MYSQL_STMT* st)
+	: stmt(st), param_count(0), column_count(0), in_use(false), digest(0)
+{
+	param_count = mysql_stmt_param_count(st);
+
+	MYSQL_RES* rm = mysql_stmt_result_metadata(st);
+	if ( rm )
+	{
+		meta.reset(rm,[](MYSQL_RES* r){mysql_free_result(r);});
+
+		column_count = mysql_num_fields(rm);
+	}
+
+	for ( int i = 0; i < param_count; i++)
+	{
+		bind.push_back(MYSQL_BIND());
+		memset(&(bind[i]),0,sizeof(MYSQL_BIND));
+
+		params.push_back(std::make_shared<Param>());
+	}
+}
+
+StatementCache::Entry::Entry(std::shared_ptr<MYSQL_RES> res)
+	: stmt(nullptr), meta(res), param_count(0), column_count(0), in_use(false), digest(0)
+{
+	if ( res )
+	{
+		column_count = mysql_num_fields(res.get());
+	}
+}
+
+StatementCache::Entry::~Entry()
+{
+	meta.reset();
+	if ( stmt )
+	{
+		mysql_stmt_close(stmt);
+	}
+}
+
+StatementCache::StatementCache(size_t capacity)
+	: capacity_(capacity), server_limit_(-1)
+{}
+
+StatementCache::EntryPtr StatementCache::prepare(MYSQL* con, const std::string& sql)
+{
+	MYSQL_STMT* stmt = mysql_stmt_init(con);
+	if(!stmt)
+	{
+		return nullptr;
+	}
+
+	int mb =  1;
+	mysql_stmt_attr_set( stmt, STMT_ATTR_UPDATE_MAX_LENGTH, &mb);
+
+	if ( mysql_stmt_prepare(stmt, sql.c_str(), sql.size()) )
+	{
+		mysql_stmt_close(stmt);
+		return nullptr;
+	}
+
+	return std::make_shared<Entry>(stmt);
+}
+
+StatementCache::EntryPtr StatementCache::checkout(MYSQL* con, const std::string& sql)
+{
+	size_t max = limit(con);
+
+	auto it = index_.find(sql);
+	if ( it != index_.end() )
+	{
+		EntryPtr e = it->second->second;
+		if ( !e->in_use )
+		{
+			lru_.splice(lru_.begin(),lru_,it->second);
+			e->in_use = true;
+			return e;
+		}
+		// busy, hand out a private copy
+		EntryPtr tmp = prepare(con,sql);
+		if(tmp)
+		{
+			tmp->in_use = true;
+		}
+		return tmp;
+	}
+
+	EntryPtr e = prepare(con,sql);
+	if ( !e && mysql_errno(con) == REPROMYSQL_ER_MAX_PREPARED_STMT_COUNT_REACHED )
+	{
+		// give back our idle statements and retry once
+		evict(0);
+		e = prepare(con,sql);
+	}
+	if(!e)
+	{
+		return nullptr;
+	}
+	e->in_use = true;
+
+	if ( max > 0 )
+	{
+		evict(max-1);
+		lru_.push_front(std::make_pair(sql,e));
+		index_[sql] = lru_.begin();
+	}
+	return e;
+}
+
+void StatementCache::evict(size_t max)
+{
+	// statements still in use stay alive with their user 
+	// and get closed once released
+	while ( lru_.size() > max )
+	{
+		index_.erase(lru_.back().first);
+		lru_.pop_back();
+	}
+}
+
+void StatementCache::clear()
+{
+	evict(0);
+}
+
+void StatementCache::capacity(size_t c)
+{
+	capacity_ = c;
+	evict(c);
+}
+
+size_t StatementCache::limit(MYSQL* con)
+{
+	if ( capacity_ == 0 )
+	{
+		return 0;
+	}
+
+	if ( server_limit_ < 0 )
+	{
+		server_limit_ = 0;
+		if ( mysql_query(con, "SELECT @@max_prepared_stmt_count") == 0 )
+		{
+			ResultSet rs(mysql_store_result(con));
+			if ( rs.fetch() && rs[0] )
+			{
+				server_limit_ = atoll(rs[0]);
+			}
+		}
+	}
+
+	if ( server_limit_ > 0 && (size_t)server_limit_ < capacity_ )
+	{
+		return (size_t)server_limit_;
+	}
+	return capacity_;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+
 mysql::mysql()
 	: con_(nullptr), id_(0)
 {
@@ -94,6 +259,7 @@ MYSQL* mysql::con()
 
 void mysql::close()
 {
+	statements_.clear();
 	if(con_)
 	{
 		mysql_close(con_);
@@ -106,15 +272,29 @@ statement::Ptr mysql::prepare(std::string sql)
 {
 	auto ptr = shared_from_this();
 
-	MYSQL_STMT* stmt = mysql_stmt_init(ptr->con());
-
-	int mb =  1;
-	mysql_stmt_attr_set( stmt, STMT_ATTR_UPDATE_MAX_LENGTH, &mb);
+	DigestStats::clock::time_point prepared;
+	if(digests_)
+	{
+		prepared = DigestStats::clock::now();
+	}
 
-	if ( mysql_stmt_prepare(stmt, sql.c_str(), sql.size()) )
+	StatementCache::EntryPtr e = statements_.checkout(ptr->con(),sql);
+	if (!e)
+	{
+		if(digests_)
+		{
+			digests_->record(DigestStats::fingerprint(sql),sql,DigestStats::clock::now()-prepared,0,true);
+		}
 		throw repro::Ex("mysql_stmt_prepare failed!");
+	}
 
-	return std::make_shared<statement>(ptr,stmt);
+	auto st = std::make_shared<statement>(ptr,e);
+	if(digests_)
+	{
+		st->sql_ = sql;
+		st->prepared_ = prepared;
+	}
+	return st;
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////
@@ -124,56 +304,47 @@ statement::Ptr mysql::prepare(std::string sql)
 
 statement::statement(std::shared_ptr<mysql> con,MYSQL_STMT* st)
 	: mysql_(con),
-	  stmt_(st,[](MYSQL_STMT* s){ mysql_stmt_close(s); }),
-	  param_count_(0),
-	  column_count_(0)
+	  entry_(std::make_shared<StatementCache::Entry>(st)),
+	  prefetch_(0)
 {
-	param_count_ = mysql_stmt_param_count(st);
-
-	MYSQL_RES* rm = mysql_stmt_result_metadata(st);
-	if ( rm )
-	{
-		prepare_meta_result_.reset(rm,[](MYSQL_RES* r){mysql_free_result(r);});
-
-		column_count_ = mysql_num_fields(rm);
-	}
+	entry_->in_use = true;
+}
 
-	if ( param_count_ > 0 )
-	{
-		for ( int i = 0; i < param_count_; i++)
-		{
-			bind_.push_back(MYSQL_BIND());
-			memset(&(bind_[i]),0,sizeof(MYSQL_BIND));
+statement::statement(std::shared_ptr<mysql> con,StatementCache::EntryPtr e)
+	: mysql_(con),
+	  entry_(e),
+	  prefetch_(0)
+{}
 
-			params_.push_back(std::make_shared<Param>());
-		}
-	}
+statement::~statement()
+{
+	entry_->in_use = false;
 }
 
 
 MYSQL_FIELD* statement::field( int i ) const
 {
-	if(!prepare_meta_result_)
+	if(!entry_->meta)
 		throw repro::Ex("no result yet");
 
-	if ( i < 0 || i >= column_count_ )
+	if ( i < 0 || i >= entry_->column_count )
 		throw repro::Ex("invalid field!");
 
-	return mysql_fetch_field_direct(prepare_meta_result_.get(), i);
+	return mysql_fetch_field_direct(entry_->meta.get(), i);
 }
 
 int statement::param_count() const {
-	return param_count_;
+	return entry_->param_count;
 }
 
 int statement::column_count() const {
-	return column_count_;
+	return entry_->column_count;
 }
 
 
 MYSQL_STMT* statement::st()
 {
-	return stmt_.get();
+	return entry_->stmt;
 }
 
 std::shared_ptr<mysql> statement::con()
@@ -182,60 +353,83 @@ std::shared_ptr<mysql> statement::con()
 }
 
 
-result::Ptr statement::query()
+void statement::bind_params()
 {
-	auto ptr = shared_from_this();
+	mysql_stmt_free_result(entry_->stmt);
 
-	mysql_stmt_free_result(ptr->stmt_.get());
+	// cached statements keep their attributes, so always set them
+	unsigned long type = prefetch_ > 0 ? CURSOR_TYPE_READ_ONLY : CURSOR_TYPE_NO_CURSOR;
+	mysql_stmt_attr_set(entry_->stmt, STMT_ATTR_CURSOR_TYPE, &type);
+	if ( prefetch_ > 0 )
+	{
+		mysql_stmt_attr_set(entry_->stmt, STMT_ATTR_PREFETCH_ROWS, &prefetch_);
+	}
 
-	if ( ptr->param_count_ > 0 )
+	if ( entry_->param_count > 0 )
 	{
-		for ( int i = 0; i < ptr->param_count_; i++)
+		for ( int i = 0; i < entry_->param_count; i++)
 		{
-			ptr->params_[i]->bind(ptr->bind_[i]);
+			entry_->params[i]->bind(entry_->bind[i]);
 		}
 
-		if (mysql_stmt_bind_param(ptr->stmt_.get(), &(ptr->bind_[0])) )
+		if (mysql_stmt_bind_param(entry_->stmt, &(entry_->bind[0])) )
 			throw repro::Ex("mysql_stmt_bind_param failed!");
 	}
+}
+
+result::Ptr statement::query()
+{
+	auto ptr = shared_from_this();
 
-	if (mysql_stmt_execute(ptr->stmt_.get()))
+	ptr->bind_params();
+
+	if (mysql_stmt_execute(ptr->st()))
 	{
+		digest(0,true);
 		std::ostringstream oss;
-		oss << "mysql_stmt_execute failed: " << mysql_stmt_error(ptr->stmt_.get());
+		oss << "mysql_stmt_execute failed: " << mysql_stmt_error(ptr->st());
 		throw repro::Ex(oss.str());
 	};
 
-	return std::make_shared<result>(ptr);
+	bool buffered = ptr->prefetch_ == 0;
+	auto r = std::make_shared<result>(ptr, buffered);
+	digest( buffered ? (long long)mysql_stmt_num_rows(st()) : -1, false);
+	return r;
 }
 
 statement::Ptr statement::execute()
 {
 	auto ptr = shared_from_this();
 
-	mysql_stmt_free_result(ptr->stmt_.get());
-
-	if ( ptr->param_count_ > 0 )
-	{
-		for ( int i = 0; i < ptr->param_count_; i++)
-		{
-			ptr->params_[i]->bind(ptr->bind_[i]);
-		}
-
-		if (mysql_stmt_bind_param(ptr->stmt_.get(), &(ptr->bind_[0])) )
-			throw repro::Ex("mysql_stmt_bind_param failed!");
-	}
+	ptr->bind_params();
 
-	if (mysql_stmt_execute(ptr->stmt_.get()))
+	if (mysql_stmt_execute(ptr->st()))
 	{
+		digest(0,true);
 		std::ostringstream oss;
-		oss << "mysql_stmt_execute failed: " << mysql_stmt_error(ptr->stmt_.get());
+		oss << "mysql_stmt_execute failed: " << mysql_stmt_error(ptr->st());
 		throw repro::Ex(oss.str());
 	};
 
+	digest( (long long)mysql_stmt_affected_rows(st()), false);
 	return ptr;
 }
 
+void statement::digest(long long rows, bool error)
+{
+	DigestStats::Ptr digests = mysql_->digests();
+	if(!digests || sql_.empty())
+	{
+		return;
+	}
+
+	if(!entry_->digest)
+	{
+		entry_->digest = DigestStats::fingerprint(sql_);
+	}
+	digests->record(entry_->digest, sql_, DigestStats::clock::now() - prepared_, rows, error);
+}
+
 
 
 
@@ -251,7 +445,7 @@ std::shared_ptr<mysql> result::con()
 	return st_->con();
 }
 
-result::result(std::shared_ptr<statement> st)
+result::result(std::shared_ptr<statement> st, bool buffered)
   : column_count_(st->column_count()),st_(st)
 {
 
@@ -260,21 +454,23 @@ result::result(std::shared_ptr<statement> st)
 		bind_.reset( new MYSQL_BIND[column_count_],[](MYSQL_BIND* m){ delete[] m;} );
 	}
 
+	if (buffered && mysql_stmt_store_result(st->st()))
+		throw repro::Ex("mysql_stmt_store_results failed!");
+
+	// stored results know their widest value
 	fields_.clear();
 	for( int i = 0; i < column_count_; i++)
 	{
 		memset(&(bind_.get()[i]),0,sizeof(MYSQL_BIND));
 
 		MYSQL_FIELD* field = st->field(i);
-		fields_.push_back( std::make_shared<Retval>( field->name, field->type, field->length) );
+		fields_.push_back( std::make_shared<Retval>( field->name, field->type, Retval::buffer_size(field,buffered)) );
 		fields_[i].get()->bind(bind_.get()[i]);
 	}
-	if (mysql_stmt_store_result(st->st()))
-		throw repro::Ex("mysql_stmt_store_results failed!");
 
 	if(column_count_ > 0)
 	{
-		if (mysql_stmt_bind_result(st.get()->stmt_.get(), bind_.get()))
+		if (mysql_stmt_bind_result(st->st(), bind_.get()))
 			throw repro::Ex("mysql_stmt_bind_result failed!");
 	}
 
@@ -292,13 +488,50 @@ const Retval& result::field(int i) const
 
 bool result::fetch()
 {
-	if ( mysql_stmt_fetch(st_.get()->stmt_.get()) )
+	int rc = mysql_stmt_fetch(st_->st());
+	if ( rc == MYSQL_DATA_TRUNCATED )
+	{
+		truncated();
+		return true;
+	}
+	if ( rc )
 	{
 		return false;
 	}
 	return true;
 }
 
+result_columns::Ptr result::fetch_columns()
+{
+	auto columns = std::make_shared<result_columns>();
+
+	if(column_count_ == 0)
+	{
+		return columns;
+	}
+
+	columns->load(st_->st(), st_->entry_->meta.get());
+
+	if (mysql_stmt_bind_result(st_->st(), bind_.get()))
+		throw repro::Ex("mysql_stmt_bind_result failed!");
+
+	return columns;
+}
+
+void result::truncated()
+{
+	bool grown = false;
+	for( int i = 0; i < column_count_; i++)
+	{
+		grown |= fields_[i]->refetch(st_->st(), bind_.get()[i], i);
+	}
+
+	if ( grown && mysql_stmt_bind_result(st_->st(), bind_.get()) )
+	{
+		throw repro::Ex("mysql_stmt_bind_result failed!");
+	}
+}
+
 
 ///////////////////////////////////////////////////////////////
 
@@ -0,0 +1,130 @@
+#include "repromysql/mysql-arena.h"
+#include <cstddef>
+
+namespace repromysql {
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+static size_t align(size_t n, size_t a)
+{
+	return (n + a - 1) / a * a;
+}
+
+// offsets within the block
+static size_t binds_at()
+{
+	return align(sizeof(ResultArena), alignof(std::max_align_t));
+}
+
+static size_t fields_at(int columns)
+{
+	return align(binds_at() + columns*sizeof(MYSQL_BIND), alignof(Retval));
+}
+
+static size_t data_at(int columns)
+{
+	return fields_at(columns) + columns*sizeof(Retval);
+}
+
+ResultArena::ResultArena(MYSQL_RES* meta, int columns, size_t capacity)
+	: columns_(columns), capacity_(capacity)
+{
+	char* block = (char*)this;
+	binds_  = (MYSQL_BIND*)(block + binds_at());
+	fields_ = (Retval*)(block + fields_at(columns));
+	data_   = block + data_at(columns);
+
+	for ( int i = 0; i < columns_; i++)
+	{
+		MYSQL_FIELD* field = mysql_fetch_field_direct(meta, i);
+		new(&fields_[i]) Retval( field->name, field->type, nullptr, 0 );
+	}
+}
+
+ResultArena::~ResultArena()
+{
+	for ( int i = 0; i < columns_; i++)
+	{
+		fields_[i].~Retval();
+	}
+}
+
+ResultArena::Ptr ResultArena::create(MYSQL_RES* meta, int columns, size_t capacity)
+{
+	char* block = new char[data_at(columns) + capacity];
+
+	return Ptr( new(block) ResultArena(meta,columns,capacity), [](ResultArena* a)
+	{
+		a->~ResultArena();
+		delete[] (char*)a;
+	});
+}
+
+bool ResultArena::fits(MYSQL_RES* meta, int columns, size_t capacity) const
+{
+	if ( columns != columns_ || capacity > capacity_ )
+	{
+		return false;
+	}
+
+	// same statement, but the schema may have changed since
+	for ( int i = 0; i < columns_; i++)
+	{
+		MYSQL_FIELD* field = mysql_fetch_field_direct(meta, i);
+		if ( field->type != fields_[i].type() || fields_[i].name() != field->name )
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+ResultArena::Ptr ResultArena::acquire(Ptr& slot, MYSQL_RES* meta, bool buffered)
+{
+	int columns = meta ? (int)mysql_num_fields(meta) : 0;
+	if ( columns == 0 )
+	{
+		return nullptr;
+	}
+
+	size_t capacity = 0;
+	for ( int i = 0; i < columns; i++)
+	{
+		MYSQL_FIELD* field = mysql_fetch_field_direct(meta, i);
+		if ( Retval::is_string(field->type) )
+		{
+			capacity += Retval::buffer_size(field,buffered) + 1;
+		}
+	}
+
+	// only the slot may hold an arena that gets reused
+	if ( !slot || slot.use_count() > 1 || !slot->fits(meta,columns,capacity) )
+	{
+		slot = create(meta,columns,capacity);
+	}
+	Ptr arena = slot;
+
+	char* data = arena->data_;
+	for ( int i = 0; i < columns; i++)
+	{
+		MYSQL_FIELD* field = mysql_fetch_field_direct(meta, i);
+		Retval& r = arena->fields_[i];
+
+		if ( Retval::is_string(field->type) )
+		{
+			unsigned long size = Retval::buffer_size(field,buffered);
+			r.use(data,size);
+			data += size + 1;
+		}
+		else
+		{
+			r.use(nullptr,0);
+		}
+
+		memset(&arena->binds_[i],0,sizeof(MYSQL_BIND));
+		r.bind(arena->binds_[i]);
+	}
+	return arena;
+}
+
+}
@@ -1,18 +1,28 @@
 #include "repromysql/mysql-async.h"
+#include "repromysql/mysql-slowlog.h"
+#include <algorithm>
+#include <cctype>
 #include <iomanip>
+#include <mutex>
+#include <map>
+#ifdef _WIN32
+#include <winsock2.h>
+#else
+#include <poll.h>
+#endif
 
 namespace repromysql {
 
 /////////////////////////////////////////////////////////////////////////////////////////////
 
 mysql_async::mysql_async()
-	: mysql_(nullptr)
+	: mysql_(nullptr), mode_(MysqlPool::THREADED), statements_(0)
 {
 	REPRO_MONITOR_INCR(mysqlAsync);	
 }
 
-mysql_async::mysql_async(MysqlPool::ResourcePtr m)
-	: mysql_(m)
+mysql_async::mysql_async(MysqlPool::ResourcePtr m, MysqlPool::Mode mode, size_t statements, QueryHook::Ptr hook, std::shared_ptr<SlowQueryLog> slowlog, DigestStats::Ptr digests, ResultCache::Ptr cache)
+	: mysql_(m), mode_(mode), statements_(statements), hook_(hook), slowlog_(slowlog), digests_(digests), cache_(cache)
 {
 	REPRO_MONITOR_INCR(mysqlAsync);	
 }
@@ -22,251 +32,1493 @@ my_ulonglong mysql_async::insert_id() {
 	return  mysql_insert_id(con());;
 }
 
+repro::Future<mysql_async::Ptr> mysql_async::invalidating(const std::string& sql, repro::Future<mysql_async::Ptr> f)
+{
+	if(!cache_)
+	{
+		return f;
+	}
+
+	auto ptr = shared_from_this();
+	auto p = repro::promise<mysql_async::Ptr>();
+
+	f.then( [ptr,p,sql](mysql_async::Ptr m)
+	{
+		ptr->written(sql);
+		p.resolve(m);
+	})
+	.otherwise(reject(p));
+
+	return p.future();
+}
+
+// tables written inside a transaction are dropped once more on COMMIT,
+// a read between the write and the commit may have cached old rows
+
+void mysql_async::written(const std::string& sql)
+{
+	size_t start = sql.find_first_not_of(" \t\r\n");
+	std::string verb = start == std::string::npos ? "" : sql.substr(start,8);
+	for( auto& c : verb)
+	{
+		c = (char)toupper((unsigned char)c);
+	}
+
+	if( verb.compare(0,6,"COMMIT") == 0 )
+	{
+		for( auto& table : dirty_)
+		{
+			cache_->invalidate(table);
+		}
+		dirty_.clear();
+		return;
+	}
+	if( verb.compare(0,8,"ROLLBACK") == 0 )
+	{
+		dirty_.clear();
+		return;
+	}
+
+	for( auto& table : ResultCache::tables(sql))
+	{
+		cache_->invalidate(table);
+		if( std::find(dirty_.begin(),dirty_.end(),table) == dirty_.end() )
+		{
+			dirty_.push_back(table);
+		}
+	}
+}
+
+std::string mysql_async::gtid()
+{
+	const char* data = nullptr;
+	size_t len = 0;
+
+	if(mysql_session_track_get_first(con(), SESSION_TRACK_GTIDS, &data, &len) != 0 || !data)
+	{
+		return "";
+	}
+	return std::string(data,len);
+}
+
 
 mysql_async::~mysql_async()
 {
-	REPRO_MONITOR_DECR(mysqlAsync);	
+	// statements run straight through statement_async, not yet logged
+	if(!slow_.empty())
+	{
+		auto log = slowlog_;
+		auto pending = std::make_shared<std::vector<std::shared_ptr<SlowQuery>>>();
+		pending->swap(slow_);
+		prio::nextTick( [log,pending]()
+		{
+			for( auto& q : *pending)
+			{
+				log->record(q);
+			}
+		});
+	}
+
+	trace(QueryHook::RELEASE,sql_);
+	REPRO_MONITOR_DECR(mysqlAsync);	
+}
+
+MYSQL* mysql_async::con()
+{
+	return mysql_.get();
+}
+
+void mysql_async::close()
+{
+	mysql_.reset();
+}
+
+
+statement_async::Ptr mysql_async::prepare(std::string sql, bool cached)
+{
+	QueryHook::clock::time_point prepared;
+	if(timed())
+	{
+		prepared = QueryHook::clock::now();
+	}
+
+	if(hook_)
+	{
+		sql_ = sql;
+		trace(QueryHook::PREPARE,sql);
+	}
+
+	StatementCache::EntryPtr e;
+	if ( cached && statements_ > 0 )
+	{
+		e = MysqlLocator::statements(con(),statements_)->checkout(con(),sql);
+	}
+	else
+	{
+		e = StatementCache::prepare(con(),sql);
+		if(e)
+		{
+			e->in_use = true;
+		}
+	}
+
+	if ( !e )
+	{
+		digest(nullptr,sql,prepared,0,true);
+		MysqlPool::Pool::invalidate(mysql_);
+		throw repro::Ex("mysql_stmt_prepare failed!");
+	}
+	auto p = std::make_shared<statement_async>(shared_from_this(),e);
+	if(hook_ || timed())
+	{
+		p->sql_ = sql;
+		p->prepared_ = prepared;
+	}
+	return p;
+}
+
+std::string mysql_async::literal(const MYSQL_TIME& t)
+{
+	char buf[34];
+	buf[0] = '\'';
+	size_t n = datetime::format(t,MYSQL_TYPE_DATETIME,buf+1);
+	buf[n+1] = '\'';
+	return std::string(buf,n+2);
+}
+
+std::string mysql_async::interpolate(const std::string& sql, const std::vector<std::string>& values)
+{
+	std::string result;
+	result.reserve(sql.size());
+
+	size_t n = 0;
+	char quote = 0;
+
+	for ( size_t i = 0; i < sql.size(); i++)
+	{
+		char c = sql[i];
+
+		if(quote)
+		{
+			result.push_back(c);
+			if ( c == '\\' && i+1 < sql.size() )
+			{
+				result.push_back(sql[++i]);
+			}
+			else if ( c == quote )
+			{
+				quote = 0;
+			}
+			continue;
+		}
+
+		if ( c == '\'' || c == '"' || c == '`' )
+		{
+			quote = c;
+			result.push_back(c);
+			continue;
+		}
+
+		// comments are copied as they are, a ? in there takes no value
+		size_t end = i;
+		if ( c == '#' || ( sql.compare(i,2,"--") == 0 && ( i+2 == sql.size() || isspace((unsigned char)sql[i+2]) ) ) )
+		{
+			end = sql.find('\n',i);
+		}
+		else if ( sql.compare(i,2,"/*") == 0 )
+		{
+			end = sql.find("*/",i+2);
+			if ( end != std::string::npos )
+			{
+				end++;
+			}
+		}
+		if ( end != i )
+		{
+			end = end == std::string::npos ? sql.size()-1 : end;
+			result.append(sql,i,end-i+1);
+			i = end;
+			continue;
+		}
+
+		if ( c == '?' )
+		{
+			if ( n >= values.size() )
+			{
+				throw repro::Ex("not enough parameters for SQL placeholders");
+			}
+			result.append(values[n++]);
+			continue;
+		}
+
+		result.push_back(c);
+	}
+
+	if ( n != values.size() )
+	{
+		throw repro::Ex("too many parameters for SQL placeholders");
+	}
+	return result;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+std::shared_ptr<MYSQL_RES> mysql_async::text_round_trip(const std::string& sql)
+{
+	MYSQL* con = this->con();
+
+	if(hook_)
+	{
+		sql_ = sql;
+		trace(QueryHook::EXECUTE,sql);
+	}
+
+	QueryHook::clock::time_point executing, executed;
+	if(timed())
+	{
+		executing = QueryHook::clock::now();
+	}
+
+	if (mysql_real_query(con, sql.c_str(), sql.size()))
+	{
+		digest(nullptr,sql,executing,0,true);
+		MysqlPool::Pool::invalidate(mysql_);
+		std::ostringstream oss;
+		oss << "mysql_real_query failed: " << mysql_error(con);
+		throw repro::Ex(oss.str());
+	}
+
+	std::shared_ptr<MYSQL_RES> res;
+
+	if(timed())
+	{
+		executed = QueryHook::clock::now();
+	}
+
+	trace(QueryHook::STORE_RESULT,sql);
+	MYSQL_RES* r = mysql_store_result(con);
+	if(r)
+	{
+		res.reset(r,[](MYSQL_RES* r){mysql_free_result(r);});
+	}
+	else if ( mysql_field_count(con) > 0 )
+	{
+		digest(nullptr,sql,executing,0,true);
+		MysqlPool::Pool::invalidate(mysql_);
+		std::ostringstream oss;
+		oss << "mysql_store_result failed: " << mysql_error(con);
+		throw repro::Ex(oss.str());
+	}
+
+	if(timed())
+	{
+		long long rows = res ? (long long)mysql_num_rows(r) : (long long)mysql_affected_rows(con);
+		digest(nullptr,sql,executing,rows,false);
+		if(slowlog_)
+		{
+			slow(sql,executing,executing,executed,rows,nullptr);
+		}
+	}
+	return res;
+}
+
+void mysql_async::digest(uint64_t* id, const std::string& sql, QueryHook::clock::time_point start, long long rows, bool error)
+{
+	if(!digests_)
+	{
+		return;
+	}
+
+	uint64_t fingerprint = id && *id ? *id : DigestStats::fingerprint(sql);
+	if(id)
+	{
+		*id = fingerprint;
+	}
+	digests_->record(fingerprint, sql, QueryHook::clock::now() - start, rows, error);
+}
+
+void mysql_async::slow(
+	const std::string& sql, 
+	QueryHook::clock::time_point prepared, 
+	QueryHook::clock::time_point executing, 
+	QueryHook::clock::time_point executed, 
+	long long rows, 
+	const statement_async* st)
+{
+	auto now = QueryHook::clock::now();
+	if ( now - prepared < slowlog_->threshold() )
+	{
+		return;
+	}
+
+	auto seconds = [](QueryHook::clock::duration d)
+	{
+		return std::chrono::duration<double>(d).count();
+	};
+
+	auto q = std::make_shared<SlowQuery>();
+	q->when = std::chrono::system_clock::now();
+	q->sql = sql;
+	q->rows = rows;
+	q->prepare = seconds(executing-prepared);
+	q->execute = seconds(executed-executing);
+	q->store = seconds(now-executed);
+	q->total = seconds(now-prepared);
+
+	if(st)
+	{
+		for( auto& param : st->entry_->params)
+		{
+			q->params.push_back(*param);
+		}
+	}
+	slow_.push_back(q);
+}
+
+void mysql_async::flush_slow()
+{
+	if(slow_.empty())
+	{
+		return;
+	}
+
+	std::vector<std::shared_ptr<SlowQuery>> pending;
+	pending.swap(slow_);
+	for( auto& q : pending)
+	{
+		slowlog_->record(q);
+	}
+}
+
+repro::Future<result_async::Ptr> mysql_async::text_query(const std::string& sql)
+{
+	auto ptr = shared_from_this();
+
+	return prio::task( [ptr,sql]()
+	{
+		std::shared_ptr<MYSQL_RES> res = ptr->text_round_trip(sql);
+		return std::make_shared<result_async>(ptr,res);
+	});
+}
+
+repro::Future<mysql_async::Ptr> mysql_async::text_execute(const std::string& sql)
+{
+	auto ptr = shared_from_this();
+
+	return prio::task( [ptr,sql]()
+	{
+		ptr->text_round_trip(sql);
+		return ptr;
+	});
+}
+
+// asked once per connection, like max_prepared_stmt_count
+
+size_t mysql_async::max_allowed_packet()
+{
+	auto session = MysqlLocator::session(con());
+	if(session->max_allowed_packet)
+	{
+		return session->max_allowed_packet;
+	}
+
+	std::shared_ptr<MYSQL_RES> res = text_round_trip("SELECT @@max_allowed_packet");
+	if(!res)
+	{
+		return 0;
+	}
+
+	MYSQL_ROW row = mysql_fetch_row(res.get());
+	if( !row || !row[0])
+	{
+		return 0;
+	}
+	session->max_allowed_packet = strtoull(row[0],nullptr,10);
+	return session->max_allowed_packet;
+}
+
+repro::Future<size_t> mysql_async::nonblocking_max_allowed_packet()
+{
+	auto p = repro::promise<size_t>();
+
+	auto session = MysqlLocator::session(con());
+	if(session->max_allowed_packet)
+	{
+		size_t max_packet = session->max_allowed_packet;
+		prio::nextTick([p,max_packet](){ p.resolve(max_packet); });
+		return p.future();
+	}
+
+	nonblocking_query("SELECT @@max_allowed_packet")
+	.then( [p,session](result_async::Ptr r)
+	{
+		session->max_allowed_packet = r->fetch() ? r->field(0).getLongLong() : 0;
+		p.resolve(session->max_allowed_packet);
+	})
+	.otherwise(reject(p));
+
+	return p.future();
+}
+
+repro::Future<mysql_async::Ptr> mysql_async::track_gtids()
+{
+	auto p = repro::promise<mysql_async::Ptr>();
+
+	auto session = MysqlLocator::session(con());
+	if(session->gtids)
+	{
+		Ptr ptr = shared_from_this();
+		prio::nextTick([p,ptr](){ p.resolve(ptr); });
+		return p.future();
+	}
+
+	execute("SET SESSION session_track_gtids = OWN_GTID")
+	.then( [p,session](mysql_async::Ptr m)
+	{
+		session->gtids = true;
+		p.resolve(m);
+	})
+	.otherwise(reject(p));
+
+	return p.future();
+}
+
+bool mysql_async::autocommitting()
+{
+	unsigned int status = con()->server_status;
+	return (status & SERVER_STATUS_AUTOCOMMIT) && !(status & SERVER_STATUS_IN_TRANS);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+// one text protocol round trip, re-entered from the event loop 
+// whenever the connection socket becomes ready.
+// the client library does not tell whether it waits for read or 
+// write readiness. a statement larger than the socket send buffer
+// waits to be sent, and the server answers nothing before it has
+// all of it, so sending waits for writability, see query_ready().
+
+class nonblocking_call : public std::enable_shared_from_this<nonblocking_call>
+{
+public:
+
+	typedef std::shared_ptr<MYSQL_RES> ResultPtr;
+
+	nonblocking_call(mysql_async::Ptr con, const std::string& sql)
+		: con_(con), sql_(sql), p_(repro::promise<ResultPtr>()), retries_(0)
+	{}
+
+	repro::Future<ResultPtr> run()
+	{
+		if(con_->timed())
+		{
+			executing_ = QueryHook::clock::now();
+		}
+
+		if(con_->hook_)
+		{
+			con_->sql_ = sql_;
+			con_->trace(QueryHook::EXECUTE,sql_);
+		}
+		query();
+		return p_.future();
+	}
+
+private:
+
+	void query()
+	{
+		net_async_status status = mysql_real_query_nonblocking(con_->con(), sql_.c_str(), sql_.size());
+		switch(status)
+		{
+			case NET_ASYNC_NOT_READY:
+			{
+				query_ready();
+				break;
+			}
+			case NET_ASYNC_ERROR:
+			{
+				fail("mysql_real_query_nonblocking failed: ");
+				break;
+			}
+			default:
+			{
+				if(con_->timed())
+				{
+					executed_ = QueryHook::clock::now();
+				}
+				con_->trace(QueryHook::STORE_RESULT,sql_);
+				store();
+			}
+		}
+	}
+
+	// a full send buffer means the statement is still going out.
+	// otherwise retry right away a few times, the buffer may have
+	// drained since the client library gave up, before waiting for
+	// the reply. waiting for the reply costs these few reads
+	void query_ready()
+	{
+		auto ptr = shared_from_this();
+		my_socket fd = mysql_get_socket(con_->con());
+
+		if(!writable(fd))
+		{
+			retries_ = 0;
+			io_.onWrite(fd)
+			.then( [ptr]()
+			{
+				ptr->query();
+			});
+			return;
+		}
+
+		if(retries_ < 3)
+		{
+			retries_++;
+			query();
+			return;
+		}
+
+		retries_ = 0;
+		io_.onRead(fd)
+		.then( [ptr]()
+		{
+			ptr->query();
+		});
+	}
+
+	static bool writable(my_socket fd)
+	{
+		pollfd p;
+		p.fd = fd;
+		p.events = POLLOUT;
+		p.revents = 0;
+#ifdef _WIN32
+		int n = WSAPoll(&p,1,0);
+#else
+		int n = poll(&p,1,0);
+#endif
+		// errors count as ready, the retry reports them
+		return n != 0;
+	}
+
+	void store()
+	{
+		MYSQL_RES* res = nullptr;
+		net_async_status status = mysql_store_result_nonblocking(con_->con(), &res);
+		switch(status)
+		{
+			case NET_ASYNC_NOT_READY:
+			{
+				auto ptr = shared_from_this();
+				io_.onRead(mysql_get_socket(con_->con()))
+				.then( [ptr]()
+				{
+					ptr->store();
+				});
+				break;
+			}
+			case NET_ASYNC_ERROR:
+			{
+				fail("mysql_store_result_nonblocking failed: ");
+				break;
+			}
+			default:
+			{
+				io_.cancel();
+
+				ResultPtr r;
+				if(res)
+				{
+					r.reset(res,[](MYSQL_RES* r){mysql_free_result(r);});
+				}
+
+				if(con_->timed())
+				{
+					long long rows = res ? (long long)mysql_num_rows(res) : (long long)mysql_affected_rows(con_->con());
+					con_->digest(nullptr,sql_,executing_,rows,false);
+					if(con_->slowlog_)
+					{
+						con_->slow(sql_,executing_,executing_,executed_,rows,nullptr);
+						con_->flush_slow();
+					}
+				}
+				p_.resolve(r);
+			}
+		}
+	}
+
+	void fail(const char* msg)
+	{
+		io_.cancel();
+
+		std::ostringstream oss;
+		oss << msg << mysql_error(con_->con());
+
+		con_->digest(nullptr,sql_,executing_,0,true);
+		MysqlPool::Pool::invalidate(con_->mysql_);
+		p_.reject(std::make_exception_ptr(repro::Ex(oss.str())));
+	}
+
+	mysql_async::Ptr con_;
+	std::string sql_;
+	repro::Promise<ResultPtr> p_;
+	prio::IO io_;
+	int retries_;
+	QueryHook::clock::time_point executing_;
+	QueryHook::clock::time_point executed_;
+};
+
+
+repro::Future<result_async::Ptr> mysql_async::nonblocking_query(const std::string& sql)
+{
+	auto ptr = shared_from_this();
+	auto p = repro::promise<result_async::Ptr>();
+
+	std::make_shared<nonblocking_call>(ptr,sql)->run()
+	.then( [p,ptr](std::shared_ptr<MYSQL_RES> res)
+	{
+		p.resolve( std::make_shared<result_async>(ptr,res) );
+	})
+	.otherwise(reject(p));
+
+	return p.future();
+}
+
+repro::Future<mysql_async::Ptr> mysql_async::nonblocking_batch(std::vector<std::string> statements)
+{
+	auto p = repro::promise<mysql_async::Ptr>();
+
+	nonblocking_batch(std::make_shared<std::vector<std::string>>(std::move(statements)),0,p);
+
+	return p.future();
+}
+
+void mysql_async::nonblocking_batch(std::shared_ptr<std::vector<std::string>> statements, size_t i, repro::Promise<mysql_async::Ptr> p)
+{
+	auto ptr = shared_from_this();
+
+	if ( i >= statements->size() )
+	{
+		prio::nextTick([p,ptr](){ p.resolve(ptr); });
+		return;
+	}
+
+	nonblocking_execute( (*statements)[i] )
+	.then( [ptr,statements,i,p](mysql_async::Ptr)
+	{
+		ptr->nonblocking_batch(statements,i+1,p);
+	})
+	.otherwise(reject(p));
+}
+
+repro::Future<mysql_async::Ptr> mysql_async::nonblocking_execute(const std::string& sql)
+{
+	auto ptr = shared_from_this();
+	auto p = repro::promise<mysql_async::Ptr>();
+
+	std::make_shared<nonblocking_call>(ptr,sql)->run()
+	.then( [p,ptr](std::shared_ptr<MYSQL_RES> res)
+	{
+		p.resolve(ptr);
+	})
+	.otherwise(reject(p));
+
+	return p.future();
+}
+
+
+statement_async::~statement_async()
+{
+	entry_->in_use = false;
+	REPRO_MONITOR_DECR(mysqlAsyncStatement);	
+}
+
+
+statement_async::statement_async(std::shared_ptr<mysql_async> con,MYSQL_STMT* st)
+	: mysql_(con),
+	  entry_(std::make_shared<StatementCache::Entry>(st)),
+	  prefetch_(0)
+{
+	entry_->in_use = true;
+	REPRO_MONITOR_INCR(mysqlAsyncStatement);	
+}
+
+statement_async::statement_async(std::shared_ptr<mysql_async> con,StatementCache::EntryPtr e)
+	: mysql_(con),
+	  entry_(e),
+	  prefetch_(0)
+{
+	REPRO_MONITOR_INCR(mysqlAsyncStatement);	
+}
+
+
+MYSQL_FIELD* statement_async::field( int i ) const
+{
+	if(!entry_->meta)
+		throw repro::Ex("no result yet");
+
+	if ( i < 0 || i >= entry_->column_count )
+		throw repro::Ex("invalid field!");
+
+	return mysql_fetch_field_direct(entry_->meta.get(), i);
+}
+
+int statement_async::param_count() const {
+	return entry_->param_count;
+}
+
+int statement_async::column_count() const {
+	return entry_->column_count;
+}
+
+
+MYSQL_STMT* statement_async::st()
+{
+	return entry_->stmt;
+}
+
+std::shared_ptr<mysql_async> statement_async::con()
+{
+	return mysql_;
+}
+
+void statement_async::bind_params()
+{
+	mysql_->trace(QueryHook::BIND,sql_);
+
+	mysql_stmt_free_result(st());
+
+	// cached statements keep their attributes, so always set them
+	unsigned long type = prefetch_ > 0 ? CURSOR_TYPE_READ_ONLY : CURSOR_TYPE_NO_CURSOR;
+	mysql_stmt_attr_set(st(), STMT_ATTR_CURSOR_TYPE, &type);
+	if ( prefetch_ > 0 )
+	{
+		mysql_stmt_attr_set(st(), STMT_ATTR_PREFETCH_ROWS, &prefetch_);
+	}
+
+	if ( entry_->param_count > 0 )
+	{
+		for ( int i = 0; i < entry_->param_count; i++)
+		{
+			entry_->params[i]->bind(entry_->bind[i]);
+		}
+
+		if (mysql_stmt_bind_param(st(), &(entry_->bind[0])) )
+		{
+			MysqlPool::Pool::invalidate(con()->mysql_);
+			throw repro::Ex("mysql_stmt_bind_param failed!");
+		}
+	}
+}
+
+result_async::Ptr statement_async::query(bool buffered)
+{
+	if ( !st() )
+	{
+		throw repro::Ex("no statement behind a text protocol result");
+	}
+
+	QueryHook::clock::time_point executing, executed;
+	if(mysql_->timed())
+	{
+		executing = QueryHook::clock::now();
+	}
+
+	bind_params();
+	send_long_data();
+
+	mysql_->trace(QueryHook::EXECUTE,sql_);
+	if (mysql_stmt_execute(st()))
+	{
+		mysql_->digest(&entry_->digest,sql_,prepared_,0,true);
+		MysqlPool::Pool::invalidate(con()->mysql_);
+		std::ostringstream oss;
+		oss << "mysql_stmt_execute failed: " << mysql_stmt_error(st());
+		throw repro::Ex(oss.str());
+	};
+
+	if(mysql_->timed())
+	{
+		executed = QueryHook::clock::now();
+	}
+
+	buffered = buffered && prefetch_ == 0;
+	auto r = std::make_shared<result_async>(shared_from_this(),buffered);
+
+	if(mysql_->timed())
+	{
+		long long rows = buffered ? (long long)mysql_stmt_num_rows(st()) : -1;
+		mysql_->digest(&entry_->digest,sql_,prepared_,rows,false);
+		if(mysql_->slowlog_)
+		{
+			mysql_->slow(sql_,prepared_,executing,executed,rows,this);
+		}
+	}
+	return r;
+}
+
+mysql_async::Ptr statement_async::execute()
+{
+	if ( !st() )
+	{
+		throw repro::Ex("no statement behind a text protocol result");
+	}
+
+	QueryHook::clock::time_point executing;
+	if(mysql_->timed())
+	{
+		executing = QueryHook::clock::now();
+	}
+
+	bind_params();
+	send_long_data();
+
+	mysql_->trace(QueryHook::EXECUTE,sql_);
+	if (mysql_stmt_execute(st()))
+	{
+		mysql_->digest(&entry_->digest,sql_,prepared_,0,true);
+		MysqlPool::Pool::invalidate(con()->mysql_);
+
+		std::ostringstream oss;
+		oss << "mysql_stmt_execute failed: " << mysql_stmt_error(st());
+		throw repro::Ex(oss.str());
+	};
+
+	if(mysql_->timed())
+	{
+		auto executed = QueryHook::clock::now();
+		long long rows = (long long)mysql_stmt_affected_rows(st());
+		mysql_->digest(&entry_->digest,sql_,prepared_,rows,false);
+		if(mysql_->slowlog_)
+		{
+			mysql_->slow(sql_,prepared_,executing,executed,rows,this);
+		}
+	}
+
+	return mysql_;
+}
+
+void statement_async::bind(int index, const Param& p)
+{
+	int i = index-1;
+	if ( i < 0 || i >= (int)entry_->params.size())
+	{
+		throw repro::Ex("invalid param index");
+	}
+	entry_->params[i] = std::make_shared<Param>(p);
+}
+
+void statement_async::upload(int index, Reader reader, size_t chunk)
+{
+	int i = index-1;
+	if ( i < 0 || i >= (int)entry_->params.size())
+	{
+		throw repro::Ex("invalid param index");
+	}
+	entry_->params[i]->set(std::string(),MYSQL_TYPE_BLOB);
+
+	Upload upload = { (unsigned int)i, reader, chunk > 0 ? chunk : 1 };
+	uploads_.push_back(upload);
+}
+
+void statement_async::send_long_data()
+{
+	if(uploads_.empty())
+	{
+		return;
+	}
+
+	// readers run once
+	std::vector<Upload> uploads;
+	uploads.swap(uploads_);
+
+	for( auto& upload : uploads)
+	{
+		std::vector<char> buf(upload.chunk);
+		try
+		{
+			while(true)
+			{
+				size_t n = upload.reader(&buf[0],buf.size());
+				if ( n == 0 )
+				{
+					break;
+				}
+
+				if ( mysql_stmt_send_long_data(st(), upload.index, &buf[0], n) )
+				{
+					MysqlPool::Pool::invalidate(con()->mysql_);
+					std::ostringstream oss;
+					oss << "mysql_stmt_send_long_data failed: " << mysql_stmt_error(st());
+					throw repro::Ex(oss.str());
+				}
+			}
+		}
+		catch(...)
+		{
+			// drop what the server collected so far
+			mysql_stmt_reset(st());
+			throw;
+		}
+	}
+}
+
+
+
+///////////////////////////////////////////////////////////////
+
+static bool is_space(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static bool is_keyword(const std::string& sql, size_t i, const char* keyword)
+{
+	if ( i > 0 && !is_space(sql[i-1]) )
+	{
+		return false;
+	}
+
+	size_t n = strlen(keyword);
+	if ( i+n > sql.size() )
+	{
+		return false;
+	}
+
+	for ( size_t j = 0; j < n; j++)
+	{
+		if ( toupper(sql[i+j]) != keyword[j] )
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+// skips a quoted literal starting at i, returns the index of the closing quote
+static size_t skip_quoted(const std::string& sql, size_t i)
+{
+	char quote = sql[i];
+	for ( i = i+1; i < sql.size(); i++)
+	{
+		if ( sql[i] == '\\' )
+		{
+			i++;
+		}
+		else if ( sql[i] == quote )
+		{
+			break;
+		}
+	}
+	return i;
 }
 
-MYSQL* mysql_async::con()
+bulk_sql::bulk_sql(const std::string& sql)
+	: params_(0)
 {
-	return mysql_.get();
+	size_t open = std::string::npos;
+
+	for ( size_t i = 0; i < sql.size(); i++)
+	{
+		char c = sql[i];
+		if ( c == '\'' || c == '"' || c == '`' )
+		{
+			i = skip_quoted(sql,i);
+			continue;
+		}
+
+		if ( is_keyword(sql,i,"VALUES") )
+		{
+			size_t j = i+6;
+			while ( j < sql.size() && is_space(sql[j]) ) j++;
+			if ( j < sql.size() && sql[j] == '(' )
+			{
+				open = j;
+				break;
+			}
+		}
+	}
+
+	if ( open == std::string::npos )
+	{
+		throw repro::Ex("bulk: expected INSERT ... VALUES (...)");
+	}
+
+	int depth = 0;
+	size_t close = std::string::npos;
+	for ( size_t i = open; i < sql.size(); i++)
+	{
+		char c = sql[i];
+		if ( c == '\'' || c == '"' || c == '`' )
+		{
+			i = skip_quoted(sql,i);
+			continue;
+		}
+		if ( c == '?' )
+		{
+			params_++;
+		}
+		if ( c == '(' )
+		{
+			depth++;
+		}
+		if ( c == ')' && --depth == 0 )
+		{
+			close = i;
+			break;
+		}
+	}
+
+	if ( close == std::string::npos )
+	{
+		throw repro::Ex("bulk: unbalanced VALUES (...)");
+	}
+
+	prefix_ = sql.substr(0,open);
+	row_    = sql.substr(open,close-open+1);
+	suffix_ = sql.substr(close+1);
 }
 
-void mysql_async::close()
+std::string bulk_sql::operator()(size_t rows) const
 {
-	mysql_.reset();
+	std::string result;
+	result.reserve(size(rows));
+
+	result.append(prefix_);
+	for ( size_t i = 0; i < rows; i++)
+	{
+		if ( i > 0 )
+		{
+			result.push_back(',');
+		}
+		result.append(row_);
+	}
+	result.append(suffix_);
+	return result;
 }
 
+size_t bulk_sql::size(size_t rows) const
+{
+	return prefix_.size() + rows*(row_.size()+1) + suffix_.size();
+}
 
-statement_async::Ptr mysql_async::prepare(std::string sql)
+std::vector<size_t> bulk_sql::chunks(const std::vector<size_t>& row_sizes, size_t max_packet) const
 {
-	MYSQL_STMT* stmt = mysql_stmt_init(con());
+	// leave headroom for protocol overhead, default to the 
+	// server's historic 4MB if the packet size is unknown
+	size_t budget = max_packet > 0 ? max_packet - max_packet/8 : 4*1024*1024;
 
-	int mb =  1;
-	mysql_stmt_attr_set( stmt, STMT_ATTR_UPDATE_MAX_LENGTH, &mb);
+	size_t max_rows = params_ > 0 ? max_params / params_ : row_sizes.size();
+	if ( max_rows == 0 )
+	{
+		max_rows = 1;
+	}
 
-	if ( mysql_stmt_prepare(stmt, sql.c_str(), sql.size()) )
+	std::vector<size_t> result;
+
+	size_t i = 0;
+	while ( i < row_sizes.size() )
 	{
-		prio::Resource::invalidate(mysql_);
-		throw repro::Ex("mysql_stmt_prepare failed!");
+		size_t n = 0;
+		size_t bytes = size(0);
+		while ( i+n < row_sizes.size() && n < max_rows )
+		{
+			size_t s = row_sizes[i+n] + row_.size() + 1;
+			if ( n > 0 && bytes + s > budget )
+			{
+				break;
+			}
+			bytes += s;
+			n++;
+		}
+		result.push_back(n);
+		i += n;
 	}
-	auto p = std::make_shared<statement_async>(shared_from_this(),stmt);
-	return p;
+	return result;
 }
 
+///////////////////////////////////////////////////////////////
+
 
-statement_async::~statement_async()
+
+std::shared_ptr<statement_async> result_async::st()
 {
-	REPRO_MONITOR_DECR(mysqlAsyncStatement);	
+	if ( st_ || !con_ )
+	{
+		return st_;
+	}
+	if ( !text_st_ )
+	{
+		text_st_ = std::make_shared<statement_async>(con_, std::make_shared<StatementCache::Entry>(res_));
+	}
+	return text_st_;
 }
 
+std::shared_ptr<mysql_async> result_async::con()
+{
+	return con_;
+}
 
-statement_async::statement_async(std::shared_ptr<mysql_async> con,MYSQL_STMT* st)
-	: mysql_(con),
-	  stmt_(st,[](MYSQL_STMT* s){ mysql_stmt_close(s); }),
-	  param_count_(0),
-	  column_count_(0)
+result_async::result_async(std::shared_ptr<statement_async> st, bool buffered)
+  :  column_count_(st->column_count()),st_(st),con_(st->con()),buffered_(buffered),cancelled_(false),fetched_(false),drained_(false)
 {
-	param_count_ = mysql_stmt_param_count(st);
+	con_->trace(QueryHook::STORE_RESULT,st->sql_);
 
-	MYSQL_RES* rm = mysql_stmt_result_metadata(st);
-	if ( rm )
+	if (buffered && mysql_stmt_store_result(st->st()))
 	{
-		prepare_meta_result_.reset(rm,[](MYSQL_RES* r){mysql_free_result(r);});
-
-		column_count_ = mysql_num_fields(rm);
+		MysqlPool::Pool::invalidate(con()->mysql_);
+		throw repro::Ex("mysql_stmt_store_results failed!");
 	}
 
-	if ( param_count_ > 0 )
+	// stored results know their widest value, streamed
+	// and cursor results start small and grow on truncation
+	if(column_count_ > 0)
 	{
-		for ( int i = 0; i < param_count_; i++)
-		{
-			bind_.push_back(MYSQL_BIND());
-			memset(&(bind_[i]),0,sizeof(MYSQL_BIND));
+		arena_ = ResultArena::acquire(st->entry_->arena, st->entry_->meta.get(), buffered);
 
-			params_.push_back(std::make_shared<Param>());
+		if (mysql_stmt_bind_result(st_->st(), arena_->binds()))
+		{
+			MysqlPool::Pool::invalidate(con()->mysql_);
+			throw repro::Ex("mysql_stmt_bind_result failed!");
 		}
 	}
 
-	REPRO_MONITOR_INCR(mysqlAsyncStatement);	
-}
+	REPRO_MONITOR_INCR(mysqlAsyncResult);
 
+}
 
-MYSQL_FIELD* statement_async::field( int i ) const
+result_async::result_async(std::shared_ptr<mysql_async> con, std::shared_ptr<MYSQL_RES> res)
+  :  column_count_(0),res_(res),con_(con),buffered_(true),cancelled_(false),fetched_(false),drained_(false)
 {
-	if(!prepare_meta_result_)
-		throw repro::Ex("no result yet");
-
-	if ( i < 0 || i >= column_count_ )
-		throw repro::Ex("invalid field!");
+	if(res_)
+	{
+		column_count_ = mysql_num_fields(res_.get());
 
-	return mysql_fetch_field_direct(prepare_meta_result_.get(), i);
-}
+		// stored text results know their widest value
+		arena_ = ResultArena::acquire(con_->arena_, res_.get(), true);
+	}
 
-int statement_async::param_count() const {
-	return param_count_;
+	REPRO_MONITOR_INCR(mysqlAsyncResult);
 }
 
-int statement_async::column_count() const {
+const int result_async::fields() const
+{
 	return column_count_;
 }
 
-
-MYSQL_STMT* statement_async::st()
+const Retval& result_async::field(int i) const
 {
-	return stmt_.get();
+	return arena_->field(i);
 }
 
-std::shared_ptr<mysql_async> statement_async::con()
+
+const Retval& result_async::field(const std::string& name) const
 {
-	return mysql_;
+	for ( int i = 0; i < column_count_; i++)
+	{
+		if( arena_->field(i).name() == name ) {
+			return field(i);
+		}
+	}
+	throw repro::Ex("unknown SQL field");
 }
 
 
-result_async::Ptr statement_async::query()
+MYSQL_FIELD* result_async::field_meta(int i) const
 {
-	mysql_stmt_free_result(stmt_.get());
-
-	if ( param_count_ > 0 )
+	if ( i < 0 || i >= column_count_ )
 	{
-		for ( int i = 0; i < param_count_; i++)
-		{
-			params_[i]->bind(bind_[i]);
-		}
+		throw repro::Ex("invalid field!");
+	}
+	if(res_)
+	{
+		return mysql_fetch_field_direct(res_.get(), i);
+	}
+	return st_->field(i);
+}
 
-		if (mysql_stmt_bind_param(stmt_.get(), &(bind_[0])) )
+void result_async::first_fetch()
+{
+	if(!fetched_)
+	{
+		fetched_ = true;
+		if(con_ && con_->hook_)
 		{
-			prio::Resource::invalidate(con()->mysql_);
-			throw repro::Ex("mysql_stmt_bind_param failed!");
+			con_->trace(QueryHook::FIRST_FETCH, st_ ? st_->sql_ : con_->sql_);
 		}
 	}
-
-	if (mysql_stmt_execute(stmt_.get()))
-	{
-		prio::Resource::invalidate(con()->mysql_);
-		std::ostringstream oss;
-		oss << "mysql_stmt_execute failed: " << mysql_stmt_error(stmt_.get());
-		throw repro::Ex(oss.str());
-	};
-
-	return std::make_shared<result_async>(shared_from_this());
 }
 
-mysql_async::Ptr statement_async::execute()
+bool result_async::fetch()
 {
-	mysql_stmt_free_result(stmt_.get());
+	first_fetch();
 
-	if ( param_count_ > 0 )
+	if(res_)
 	{
-		for ( int i = 0; i < param_count_; i++)
+		MYSQL_ROW row = mysql_fetch_row(res_.get());
+		if(!row)
 		{
-			params_[i]->bind(bind_[i]);
+			return false;
 		}
 
-		if (mysql_stmt_bind_param(stmt_.get(), &(bind_[0])) )
+		unsigned long* lengths = mysql_fetch_lengths(res_.get());
+		for( int i = 0; i < column_count_; i++)
 		{
-			prio::Resource::invalidate(con()->mysql_);
-			throw repro::Ex("mysql_stmt_bind_param failed!");
+			arena_->field(i).assign(row[i],lengths[i]);
 		}
+		return true;
 	}
 
-	if (mysql_stmt_execute(stmt_.get()))
+	if(!st_)
 	{
-		prio::Resource::invalidate(con()->mysql_);
-
-		std::ostringstream oss;
-		oss << "mysql_stmt_execute failed: " << mysql_stmt_error(stmt_.get());
-		throw repro::Ex(oss.str());
-	};
+		return false;
+	}
 
-	return mysql_;
+	int rc = mysql_stmt_fetch(st_->st());
+	if ( rc == MYSQL_DATA_TRUNCATED )
+	{
+		truncated();
+		return true;
+	}
+	if ( rc )
+	{
+		drained_ = rc == MYSQL_NO_DATA;
+		return false;
+	}
+	return true;
 }
 
+result_columns::Ptr result_async::fetch_columns()
+{
+	first_fetch();
 
+	auto columns = std::make_shared<result_columns>();
 
-///////////////////////////////////////////////////////////////
+	if(res_)
+	{
+		columns->load(res_.get());
+		return columns;
+	}
 
+	if(!st_ || column_count_ == 0)
+	{
+		return columns;
+	}
 
+	try
+	{
+		columns->load(st_->st(), st_->entry_->meta.get());
+	}
+	catch(...)
+	{
+		rebind();
+		throw;
+	}
+	drained_ = true;
 
-std::shared_ptr<statement_async> result_async::st()
-{
-	return st_;
+	rebind();
+	return columns;
 }
 
-std::shared_ptr<mysql_async> result_async::con()
+// fetch() and field() keep working on the Retval bindings, 
+// after as() or fetch_columns() bound buffers of their own
+
+void result_async::rebind()
 {
-	return st_->con();
+	if (mysql_stmt_bind_result(st_->st(), arena_->binds()))
+	{
+		MysqlPool::Pool::invalidate(con_->mysql_);
+		throw repro::Ex("mysql_stmt_bind_result failed!");
+	}
 }
 
-result_async::result_async(std::shared_ptr<statement_async> st)
-  :  column_count_(st->column_count()),st_(st)
+void result_async::truncated()
 {
-
-	if ( column_count_ > 0 )
+	bool grown = false;
+	for( int i = 0; i < column_count_; i++)
 	{
-		bind_.reset( new MYSQL_BIND[column_count_],[](MYSQL_BIND* m){ delete[] m;} );
+		if( i < (int)chunked_.size() && chunked_[i] )
+		{
+			continue;
+		}
+		grown |= arena_->field(i).refetch(st_->st(), arena_->binds()[i], i);
 	}
 
-	fields_.clear();
-	for( int i = 0; i < column_count_; i++)
+	if ( grown && mysql_stmt_bind_result(st_->st(), arena_->binds()) )
 	{
-		memset(&(bind_.get()[i]),0,sizeof(MYSQL_BIND));
+		MysqlPool::Pool::invalidate(con_->mysql_);
+		throw repro::Ex("mysql_stmt_bind_result failed!");
+	}
+}
 
-		MYSQL_FIELD* field = st->field(i);
-		fields_.push_back( std::make_shared<Retval>( field->name, field->type, field->length) );
-		fields_[i].get()->bind(bind_.get()[i]);
+void result_async::chunked(int i)
+{
+	if ( i < 0 || i >= column_count_ )
+	{
+		throw repro::Ex("invalid field!");
 	}
+	chunked_.resize(column_count_,false);
+	chunked_[i] = true;
+}
 
-	if (mysql_stmt_store_result(st->st()))
+void result_async::read(int i, Sink sink, size_t chunk)
+{
+	if(!st_)
 	{
-		prio::Resource::invalidate(con()->mysql_);
-		throw repro::Ex("mysql_stmt_store_results failed!");
+		throw repro::Ex("read() needs a prepared statement result");
+	}
+	if ( i < 0 || i >= column_count_ )
+	{
+		throw repro::Ex("invalid field!");
 	}
 
-	if(column_count_ > 0)
+	std::vector<char> buf(chunk > 0 ? chunk : 1);
+	unsigned long length = 0;
+	mybool is_null = 0;
+	mybool error = 0;
+
+	MYSQL_BIND b;
+	memset(&b,0,sizeof(MYSQL_BIND));
+	b.buffer_type = MYSQL_TYPE_BLOB;
+	b.buffer = &buf[0];
+	b.buffer_length = buf.size();
+	b.length = &length;
+	b.is_null = &is_null;
+	b.error = &error;
+
+	// length reports the whole value on every call
+	unsigned long offset = 0;
+	do
 	{
-		if (mysql_stmt_bind_result(st_->st(), bind_.get()))
+		if ( mysql_stmt_fetch_column(st_->st(), &b, i, offset) )
 		{
-			prio::Resource::invalidate(con()->mysql_);
-			throw repro::Ex("mysql_stmt_bind_result failed!");
+			std::ostringstream oss;
+			oss << "mysql_stmt_fetch_column failed: " << mysql_stmt_error(st_->st());
+			throw repro::Ex(oss.str());
+		}
+		if(is_null)
+		{
+			return;
+		}
+
+		unsigned long n = length - offset < buf.size() ? length - offset : buf.size();
+		if ( n > 0 )
+		{
+			sink(&buf[0],n);
 		}
+		offset += n;
 	}
+	while( offset < length );
+}
 
-	REPRO_MONITOR_INCR(mysqlAsyncResult);
+result_async::~result_async()
+{
+	// pending unbuffered rows would leave the connection out of sync,
+	// rows behind a server side cursor do not. draining them here would
+	// stall whichever thread drops the result, often the event loop,
+	// so an undrained result costs the connection like cancel()
+	if ( !buffered_ && !cancelled_ && st_ && st_->prefetch() == 0 )
+	{
+		if(drained_)
+		{
+			mysql_stmt_free_result(st_->st());
+		}
+		else
+		{
+			MysqlPool::Pool::invalidate(con_->mysql_);
+		}
+	}
+	REPRO_MONITOR_DECR(mysqlAsyncResult);
+}
 
+void result_async::cancel()
+{
+	cancelled_ = true;
+	if(con_)
+	{
+		MysqlPool::Pool::invalidate(con_->mysql_);
+	}
 }
 
-const int result_async::fields() const
+repro::Future<> result_async::stream(size_t n, Consumer consumer)
 {
-	return column_count_;
+	auto p = repro::promise<>();
+
+	stream(shared_from_this(), n > 0 ? n : 1, consumer, p);
+
+	return p.future();
 }
 
-const Retval& result_async::field(int i) const
+void result_async::stream(Ptr r, size_t n, Consumer consumer, repro::Promise<> p)
 {
-	return *(fields_[i].get());
+	prio::task( [r,n]()
+	{
+		auto batch = std::make_shared<result_batch>(r->fields());
+		while( batch->rows() < n && r->fetch() )
+		{
+			batch->add(*r);
+		}
+
+		if ( batch->rows() < n && r->st_ && mysql_stmt_errno(r->st_->st()) )
+		{
+			std::ostringstream oss;
+			oss << "mysql_stmt_fetch failed: " << mysql_stmt_error(r->st_->st());
+			r->cancel();
+			throw repro::Ex(oss.str());
+		}
+		return batch;
+	})
+	.then( [r,n,consumer,p](result_batch::Ptr batch)
+	{
+		if ( batch->rows() == 0 )
+		{
+			p.resolve();
+			return;
+		}
+
+		bool done = batch->rows() < n;
+
+		consumer(batch)
+		.then( [r,n,consumer,p,done]()
+		{
+			if(done)
+			{
+				p.resolve();
+				return;
+			}
+			stream(r,n,consumer,p);
+		})
+		.otherwise( [r,p](const std::exception_ptr ex)
+		{
+			r->cancel();
+			p.reject(ex);
+		});
+	})
+	.otherwise(reject(p));
 }
 
+///////////////////////////////////////////////////////////////
 
-const Retval& result_async::field(const std::string& name) const
+void result_batch::add(const result_async& r)
 {
-	for ( unsigned int i = 0; i < fields_.size(); i++)
+	for ( int i = 0; i < column_count_; i++)
 	{
-		if( fields_[i].get()->name() == name ) {
-			return field(i);
-		}
+		cells_.push_back(r.field(i));
+		cells_.back().detach();
 	}
-	throw repro::Ex("unknown SQL field");
 }
 
-
-bool result_async::fetch()
+const Retval& result_batch::field(size_t row, const std::string& name) const
 {
-	if ( mysql_stmt_fetch(st_->st()) )
+	for ( int i = 0; i < column_count_ && i < (int)cells_.size(); i++)
 	{
-		return false;
+		if( cells_[i].name() == name ) {
+			return field(row,i);
+		}
 	}
-	return true;
+	throw repro::Ex("unknown SQL field");
 }
 
 ///////////////////////////////////////////////////////////////
@@ -307,8 +1559,80 @@ repro::Future<MysqlLocator::type> MysqlLocator::retrieve(const std::string& u)
 	return p.future();
 }
 
+// prepared statement caches and session state live next to the pooled 
+// connection and are dropped right before the connection gets closed
+
+static std::mutex& statements_mutex()
+{
+	static std::mutex m;
+	return m;
+}
+
+static std::map<MYSQL*,std::shared_ptr<StatementCache>>& statements_map()
+{
+	static std::map<MYSQL*,std::shared_ptr<StatementCache>> map;
+	return map;
+}
+
+static std::map<MYSQL*,std::shared_ptr<SessionState>>& sessions_map()
+{
+	static std::map<MYSQL*,std::shared_ptr<SessionState>> map;
+	return map;
+}
+
+std::shared_ptr<StatementCache> MysqlLocator::statements(type t, size_t capacity)
+{
+	std::lock_guard<std::mutex> lock(statements_mutex());
+
+	auto& map = statements_map();
+	auto it = map.find(t);
+	if ( it != map.end() )
+	{
+		if ( it->second->capacity() != capacity )
+		{
+			it->second->capacity(capacity);
+		}
+		return it->second;
+	}
+
+	auto cache = std::make_shared<StatementCache>(capacity);
+	map[t] = cache;
+	return cache;
+}
+
+std::shared_ptr<SessionState> MysqlLocator::session(type t)
+{
+	std::lock_guard<std::mutex> lock(statements_mutex());
+
+	auto& state = sessions_map()[t];
+	if ( !state )
+	{
+		state = std::make_shared<SessionState>();
+	}
+	return state;
+}
+
 void MysqlLocator::free( MysqlLocator::type t)
 {
+	std::shared_ptr<StatementCache> cache;
+	{
+		std::lock_guard<std::mutex> lock(statements_mutex());
+
+		sessions_map().erase(t);
+
+		auto& map = statements_map();
+		auto it = map.find(t);
+		if ( it != map.end() )
+		{
+			cache = it->second;
+			map.erase(it);
+		}
+	}
+	if(cache)
+	{
+		cache->clear();
+	}
+
 	mysql_close(t);
 }
 
@@ -317,7 +1641,7 @@ void MysqlLocator::free( MysqlLocator::type t)
 repro::Future<MysqlPool::ResourcePtr> MysqlPool::get()
 {
 	auto p = repro::promise<ResourcePtr>();
-	pool_.get(url_)
+	pool_->get()
 	.then( [p](ResourcePtr r)
 	{
 		p.resolve(r);
@@ -336,10 +1660,18 @@ repro::Future<std::shared_ptr<mysql_async>> MysqlPool::con()
 {
 	auto p = repro::promise<mysql_async::Ptr>();
 
+	Mode mode = mode_;
+	size_t statements = statements_;
+	QueryHook::Ptr hook = hook_;
+	std::shared_ptr<SlowQueryLog> slowlog = slowlog_;
+	DigestStats::Ptr digests = digests_;
+	ResultCache::Ptr cache = cache_;
 	get()
-	.then( [p] (MysqlPool::ResourcePtr ptr)
+	.then( [p,mode,statements,hook,slowlog,digests,cache] (MysqlPool::ResourcePtr ptr)
 	{
-		p.resolve( std::make_shared<mysql_async>(ptr) );
+		auto m = std::make_shared<mysql_async>(ptr,mode,statements,hook,slowlog,digests,cache);
+		m->trace(QueryHook::ACQUIRE,m->sql_);
+		p.resolve(m);
 	})
 	.otherwise(reject(p));
 
@@ -1,6 +1,5 @@
 #include "repromysql/mysql-bindings.h"
 #include <iomanip>
-#include <regex>
 
 namespace repromysql {
 
@@ -19,6 +18,7 @@ void Binding::init()
 {
 	is_null_        = false;
 	is_err_         = false;
+	is_unsigned_    = false;
 
 	buf_.reset();
 	maxlen_  	    = 0;
@@ -83,6 +83,7 @@ void Binding::bind(MYSQL_BIND& bind )
 	}
 	bind.is_null = &is_null_;
 	bind.error   = &is_err_;
+	bind.is_unsigned = is_unsigned_;
 }
 
 ///////////////////////////////////////////////////////////////
@@ -106,43 +107,30 @@ void Param::set( const char* s, enum_field_types type )
 	return set(tmp,type);
 }
 
-int asInt(const std::string& s)
-{
-	std::istringstream iss(s);
-	int i;
-	iss >> i;
-	return i;
-}
 
 void Param::set( const std::string& s, enum_field_types type )
 {
 	type_ = type;
-	std::istringstream iss(s);
+	is_unsigned_ = false;
 	switch(type_)
 	{
 		case MYSQL_TYPE_TINY:
 		case MYSQL_TYPE_SHORT:
 		case MYSQL_TYPE_LONG:
 		{
-			int i;
-			iss >> i;
-			u_.intval_ = i;
+			u_.intval_ = convert::parse<int>(s);
 			break;
 		}
 		case MYSQL_TYPE_LONGLONG:
 		case MYSQL_TYPE_INT24:
 		{
-			long long l;
-			iss >> l;
-			u_.longlongval_ = l;
+			u_.longlongval_ = convert::parse<long long>(s);
 			break;
 		}
 		case MYSQL_TYPE_FLOAT:
 		case MYSQL_TYPE_DOUBLE:
 		{
-			double d;
-			iss >> d;
-			u_.doubleval_ = d;
+			u_.doubleval_ = convert::parse<double>(s);
 			break;
 		}
 		case MYSQL_TYPE_TIME:
@@ -150,36 +138,7 @@ void Param::set( const std::string& s, enum_field_types type )
 		case MYSQL_TYPE_DATETIME:
 		case MYSQL_TYPE_TIMESTAMP:
 		{
-			memset(&u_.timeval_,0,sizeof(MYSQL_TIME));
-
-			std::cmatch res;
-			std::regex rx("^(\\d\\d\\d\\d)-(\\d\\d)-(\\d\\d) ?(\\d\\d)?:?(\\d\\d)?:?(\\d\\d)?");
-
-			std::regex_search(s.c_str(),res,rx);
-			int nmatches = res.size();
-
-			if ( nmatches > 1) {
-				u_.timeval_.year = asInt(res.str(1));
-			}
-			if ( nmatches > 2) {
-				u_.timeval_.month = asInt(res.str(2));
-			}
-			if ( nmatches > 3) {
-				u_.timeval_.day = asInt(res.str(3));
-			}
-			if ( nmatches > 4) {
-				u_.timeval_.hour = asInt(res.str(4));
-			}
-			if ( nmatches > 5) {
-				u_.timeval_.minute = asInt(res.str(5));
-			}
-			if ( nmatches > 6) {
-				u_.timeval_.second = asInt(res.str(6));
-			}
-			std::ostringstream oss;
-			oss << u_.timeval_.year << "-" << u_.timeval_.month << "-" << u_.timeval_.day << " ";
-			oss << u_.timeval_.hour << ":" << u_.timeval_.minute << ":" << u_.timeval_.second;
-			std::cerr << oss.str() << std::endl;
+			datetime::parse(s,u_.timeval_);
 			break;
 		}
 		case MYSQL_TYPE_VAR_STRING:
@@ -190,7 +149,7 @@ void Param::set( const std::string& s, enum_field_types type )
 		{
 			int n = s.size()+1;
 			char* buf = new char[n];
-			strncpy(buf,s.c_str(),n);
+			memcpy(buf,s.c_str(),n);
 			buf_.reset(buf,[](const char* c){delete[] c;});
 			u_.strlen_ = s.size();
 			break;
@@ -209,6 +168,7 @@ void Param::set( const std::string& s, enum_field_types type )
 void Param::set( MYSQL_TIME& ts, enum_field_types type )
 {
 	type_ = type;
+	is_unsigned_ = false;
 
 	switch(type_)
 	{
@@ -236,6 +196,11 @@ void Param::set( MYSQL_TIME& ts, enum_field_types type )
 		case MYSQL_TYPE_DECIMAL:
 		case MYSQL_TYPE_NEWDECIMAL:
 		{
+			char* buf = new char[32];
+			size_t n = datetime::format(ts,MYSQL_TYPE_DATETIME,buf);
+			buf[n] = 0;
+			buf_.reset(buf,[](const char* c){delete[] c;});
+			u_.strlen_ = n;
 			break;
 		}
 		default :
@@ -250,6 +215,12 @@ void Param::set( MYSQL_TIME& ts, enum_field_types type )
 }
 
 
+void Param::set( datetime::clock::time_point tp, enum_field_types type )
+{
+	MYSQL_TIME t = datetime::from_time_point(tp);
+	set(t,type);
+}
+
 void Param::setNull()
 {
 	is_null_ = true;
@@ -261,7 +232,7 @@ void Param::setNull()
 ///////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////
 
-Retval::Retval(const char* name, enum_field_types type, int size )
+Retval::Retval(const char* name, enum_field_types type, unsigned long size )
 	: name_(name)
 {
 	type_ = type;
@@ -287,76 +258,351 @@ Retval::Retval(const char* name, enum_field_types type, int size )
 }
 
 
-
-const std::string Retval::getString() const
+void Retval::assign(const char* s, unsigned long len)
 {
+	is_null_ = false;
+	is_err_  = false;
+
+	if(s == nullptr)
+	{
+		is_null_ = true;
+		return;
+	}
+
 	switch( type_ )
 	{
 		case MYSQL_TYPE_TINY:
 		case MYSQL_TYPE_SHORT:
 		case MYSQL_TYPE_LONG:
 		{
-			std::ostringstream oss;
-			oss << u_.intval_;
-			return oss.str();
+			u_.intval_ = convert::parse<int>(std::string_view(s,len));
+			break;
+		}
+		case MYSQL_TYPE_LONGLONG:
+		case MYSQL_TYPE_INT24:
+		{
+			u_.longlongval_ = convert::parse<long long>(std::string_view(s,len));
+			break;
 		}
 		case MYSQL_TYPE_FLOAT:
 		case MYSQL_TYPE_DOUBLE:
+		{
+			u_.doubleval_ = convert::parse<double>(std::string_view(s,len));
+			break;
+		}
+		case MYSQL_TYPE_TIME:
+		case MYSQL_TYPE_DATE:
+		case MYSQL_TYPE_DATETIME:
+		case MYSQL_TYPE_TIMESTAMP:
+		{
+			datetime::parse(std::string_view(s,len),u_.timeval_);
+			break;
+		}
+		case MYSQL_TYPE_VAR_STRING:
+		case MYSQL_TYPE_STRING:
+		case MYSQL_TYPE_BLOB:
+		case MYSQL_TYPE_DECIMAL:
+		case MYSQL_TYPE_NEWDECIMAL:
+		{
+			if ( !buf_ || len+1 > maxlen_ )
+			{
+				maxlen_ = len+1;
+				buf_.reset(new char[maxlen_],[](const char* c){delete[] c;});
+			}
+			memcpy(buf_.get(),s,len);
+			buf_.get()[len] = 0;
+			u_.strlen_ = len;
+			break;
+		}
+		case MYSQL_TYPE_NULL:
+		{
+			is_null_ = true;
+			break;
+		}
+		default :
 		{
 			std::ostringstream oss;
-			oss << u_.doubleval_;
-			return oss.str();
+			oss << "assign: unsupported mysql data type: " << type_;
+			throw repro::Ex(oss.str());
+			break;
+		}
+	}
+}
+
+Retval::Retval(const char* name, enum_field_types type, char* buf, unsigned long size )
+	: name_(name)
+{
+	type_ = type;
+	use(buf,size);
+	REPRO_MONITOR_INCR(mysqlRetval);
+}
+
+void Retval::use(char* buf, unsigned long size)
+{
+	is_null_ = false;
+	is_err_  = false;
+
+	if ( !is_string(type_) )
+	{
+		return;
+	}
+
+	// aliasing an empty owner: no control block, no ownership
+	buf_ = std::shared_ptr<char>( std::shared_ptr<char>(), buf );
+	maxlen_ = u_.strlen_ = size+1;
+}
+
+bool Retval::is_string(enum_field_types type)
+{
+	switch( type )
+	{
+		case MYSQL_TYPE_VAR_STRING:
+		case MYSQL_TYPE_STRING:
+		case MYSQL_TYPE_BLOB:
+		case MYSQL_TYPE_DECIMAL:
+		case MYSQL_TYPE_NEWDECIMAL:
+		{
+			return true;
+		}
+		default :
+		{
+			return false;
+		}
+	}
+}
+
+unsigned long Retval::buffer_size(const MYSQL_FIELD* field, bool buffered)
+{
+	const unsigned long initial = 256;
+
+	if(buffered)
+	{
+		return field->max_length;
+	}
+	return field->length < initial ? field->length : initial;
+}
+
+bool Retval::refetch(MYSQL_STMT* st, MYSQL_BIND& b, unsigned int i)
+{
+	if ( !is_string(type_) || !is_err_ || is_null_ || u_.strlen_ < maxlen_ )
+	{
+		return false;
+	}
+
+	// at least double, so a column of growing values rebinds rarely
+	unsigned long n = u_.strlen_+1;
+	if ( n < maxlen_*2 )
+	{
+		n = maxlen_*2;
+	}
+	maxlen_ = n;
+	buf_.reset(new char[maxlen_],[](const char* c){delete[] c;});
+
+	b.buffer = buf_.get();
+	b.buffer_length = maxlen_;
+
+	if ( mysql_stmt_fetch_column(st,&b,i,0) )
+	{
+		throw repro::Ex("mysql_stmt_fetch_column failed");
+	}
+	is_err_ = false;
+	return true;
+}
+
+void Retval::detach()
+{
+	if ( !buf_ )
+	{
+		return;
+	}
+
+	unsigned long n = u_.strlen_;
+	if ( maxlen_ > 0 && n > maxlen_-1 )
+	{
+		n = maxlen_-1;
+	}
+	if ( is_null_ )
+	{
+		n = 0;
+	}
+
+	// already private and tight, e.g. a copy of a borrowed buffer
+	if ( buf_.use_count() == 1 && maxlen_ == n+1 )
+	{
+		return;
+	}
+
+	char* buf = new char[n+1];
+	memcpy(buf,buf_.get(),n);
+	buf[n] = 0;
+
+	buf_.reset(buf,[](const char* c){delete[] c;});
+	maxlen_ = n+1;
+}
+
+// bytes of the value union a packed cell keeps, 0 for strings
+
+static size_t packed_size(enum_field_types t)
+{
+	switch(t)
+	{
+		case MYSQL_TYPE_TINY:
+		case MYSQL_TYPE_SHORT:
+		case MYSQL_TYPE_LONG:
+		{
+			return sizeof(int);
 		}
 		case MYSQL_TYPE_LONGLONG:
 		case MYSQL_TYPE_INT24:
 		{
-			std::ostringstream oss;
-			oss << u_.longlongval_;
-			return oss.str();
+			return sizeof(long long int);
+		}
+		case MYSQL_TYPE_FLOAT:
+		case MYSQL_TYPE_DOUBLE:
+		{
+			return sizeof(double);
 		}
 		case MYSQL_TYPE_TIME:
+		case MYSQL_TYPE_DATE:
+		case MYSQL_TYPE_DATETIME:
+		case MYSQL_TYPE_TIMESTAMP:
 		{
-			std::ostringstream oss;
-			oss << u_.timeval_.hour << ":" << u_.timeval_.minute << ":" << u_.timeval_.second;
-			return oss.str();
+			return sizeof(MYSQL_TIME);
+		}
+		default :
+		{
+			return 0;
+		}
+	}
+}
+
+void Retval::pack(std::string& out) const
+{
+	switch( type_ )
+	{
+		case MYSQL_TYPE_VAR_STRING:
+		case MYSQL_TYPE_STRING:
+		case MYSQL_TYPE_BLOB:
+		case MYSQL_TYPE_DECIMAL:
+		case MYSQL_TYPE_NEWDECIMAL:
+		{
+			unsigned long n = u_.strlen_;
+			if ( maxlen_ > 0 && n > maxlen_-1 )
+			{
+				n = maxlen_-1;
+			}
+			if ( buf_ && !is_null_ )
+			{
+				out.append(buf_.get(),n);
+			}
+			out.push_back(0);
 			break;
 		}
-		case MYSQL_TYPE_DATE:
+		case MYSQL_TYPE_NULL:
 		{
-			std::ostringstream oss;
-			oss << u_.timeval_.year << "-" << u_.timeval_.month << "-" << u_.timeval_.day;
-			return oss.str();
 			break;
 		}
-		case MYSQL_TYPE_DATETIME:
+		default :
 		{
-			std::ostringstream oss;
-			oss << u_.timeval_.year << "-" << u_.timeval_.month << "-" << u_.timeval_.day << " ";
-			oss << u_.timeval_.hour << ":" << u_.timeval_.minute;
-			return oss.str();
+			out.append( (const char*)&u_, packed_size(type_) );
+		}
+	}
+}
+
+void Retval::unpack(const char* data, unsigned long len, const std::shared_ptr<const void>& owner)
+{
+	is_null_ = false;
+	is_err_  = false;
+
+	switch( type_ )
+	{
+		case MYSQL_TYPE_VAR_STRING:
+		case MYSQL_TYPE_STRING:
+		case MYSQL_TYPE_BLOB:
+		case MYSQL_TYPE_DECIMAL:
+		case MYSQL_TYPE_NEWDECIMAL:
+		{
+			buf_ = std::shared_ptr<char>( owner, const_cast<char*>(data) );
+			maxlen_ = len;
+			u_.strlen_ = len ? len-1 : 0;
 			break;
 		}
-		case MYSQL_TYPE_TIMESTAMP:
+		case MYSQL_TYPE_NULL:
 		{
-			std::ostringstream oss;
-			oss << u_.timeval_.year << "-" << u_.timeval_.month << "-" << u_.timeval_.day << " ";
-			oss << u_.timeval_.hour << ":" << u_.timeval_.minute << ":" << u_.timeval_.second;
-			return oss.str();
+			is_null_ = true;
+			break;
 		}
+		default :
+		{
+			memcpy( &u_, data, len < sizeof(u_) ? len : sizeof(u_) );
+		}
+	}
+}
+
+std::string_view Retval::view() const
+{
+	switch( type_ )
+	{
 		case MYSQL_TYPE_VAR_STRING:
 		case MYSQL_TYPE_STRING:
 		case MYSQL_TYPE_BLOB:
 		case MYSQL_TYPE_DECIMAL:
 		case MYSQL_TYPE_NEWDECIMAL:
 		{
-			if (!buf_)
-				return "";
-			if (is_null_)
-				return "";
-			if (is_err_)
-				return "";
+			if (!buf_ || is_null_ || is_err_)
+				return std::string_view();
+
+			// the client library reports the full length, 
+			// the buffer may hold less
+			unsigned long n = u_.strlen_;
+			if ( n > maxlen_ )
+			{
+				n = maxlen_;
+			}
+			return std::string_view(buf_.get(),n);
+		}
+		default :
+		{
+			return std::string_view();
+		}
+	}
+}
 
-			return buf_.get();
+const std::string Retval::getString() const
+{
+	switch( type_ )
+	{
+		case MYSQL_TYPE_TINY:
+		case MYSQL_TYPE_SHORT:
+		case MYSQL_TYPE_LONG:
+		{
+			return convert::format(u_.intval_);
+		}
+		case MYSQL_TYPE_FLOAT:
+		case MYSQL_TYPE_DOUBLE:
+		{
+			return convert::format(u_.doubleval_);
+		}
+		case MYSQL_TYPE_LONGLONG:
+		case MYSQL_TYPE_INT24:
+		{
+			return convert::format(u_.longlongval_);
+		}
+		case MYSQL_TYPE_TIME:
+		case MYSQL_TYPE_DATE:
+		case MYSQL_TYPE_DATETIME:
+		case MYSQL_TYPE_TIMESTAMP:
+		{
+			char buf[32];
+			return std::string(buf,datetime::format(u_.timeval_,type_,buf));
+		}
+		case MYSQL_TYPE_VAR_STRING:
+		case MYSQL_TYPE_STRING:
+		case MYSQL_TYPE_BLOB:
+		case MYSQL_TYPE_DECIMAL:
+		case MYSQL_TYPE_NEWDECIMAL:
+		{
+			return std::string(view());
 		}
 		case MYSQL_TYPE_NULL:
 		{
@@ -401,6 +647,37 @@ const MYSQL_TIME& Retval::getTime() const
 	return u_.timeval_;
 }
 
+datetime::clock::time_point Retval::getTimePoint() const
+{
+	if(null() || err())
+	{
+		return datetime::clock::time_point();
+	}
+
+	switch( type_ )
+	{
+		case MYSQL_TYPE_TIME:
+		case MYSQL_TYPE_DATE:
+		case MYSQL_TYPE_DATETIME:
+		case MYSQL_TYPE_TIMESTAMP:
+		{
+			return datetime::to_time_point(u_.timeval_);
+		}
+		case MYSQL_TYPE_VAR_STRING:
+		case MYSQL_TYPE_STRING:
+		case MYSQL_TYPE_BLOB:
+		{
+			MYSQL_TIME t;
+			datetime::parse(view(),t);
+			return datetime::to_time_point(t);
+		}
+		default :
+		{
+			return datetime::clock::time_point();
+		}
+	}
+}
+
 const long long int Retval::getLongLong() const
 {
 	return getNumber<long long>();
@@ -409,7 +686,7 @@ const long long int Retval::getLongLong() const
 
 
 ResultSet::ResultSet(MYSQL_RES* res)
-	: result_(res, [](MYSQL_RES* r){mysql_free_result(r);} ), num_fields_(0),row_(nullptr)
+	: result_(res, [](MYSQL_RES* r){mysql_free_result(r);} ), num_fields_(0),row_(nullptr),lengths_(nullptr)
 {
 	if(result_ != NULL) {
 		num_fields_ = mysql_num_fields(result_.get());
@@ -433,8 +710,13 @@ bool ResultSet::fetch()
 	}
 
 	row_ = mysql_fetch_row(result_.get());
+	if(!row_)
+	{
+		return false;
+	}
 
-	return row_ != 0;
+	lengths_ = mysql_fetch_lengths(result_.get());
+	return true;
 }
 
 int ResultSet::num_fields() {
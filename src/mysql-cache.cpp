@@ -0,0 +1,454 @@
+#include "repromysql/mysql-cache.h"
+#include "repromysql/mysql-async.h"
+#include <algorithm>
+#include <cctype>
+
+namespace repromysql {
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+std::shared_ptr<CachedRows> CachedRows::materialize(result_async& r)
+{
+	auto rows = std::make_shared<CachedRows>();
+
+	int n = r.fields();
+	rows->columns_.reserve(n);
+	for ( int i = 0; i < n; i++)
+	{
+		const Retval& f = r.field(i);
+		rows->columns_.emplace_back(f.name().c_str(), f.type(), 0);
+	}
+
+	while(r.fetch())
+	{
+		for ( int i = 0; i < n; i++)
+		{
+			const Retval& f = r.field(i);
+			rows->offsets_.push_back( (uint32_t)rows->data_.size() );
+			rows->nulls_.push_back( f.null() );
+			if(!f.null())
+			{
+				f.pack(rows->data_);
+			}
+		}
+	}
+	rows->offsets_.push_back( (uint32_t)rows->data_.size() );
+
+	rows->data_.shrink_to_fit();
+	rows->offsets_.shrink_to_fit();
+	return rows;
+}
+
+size_t CachedRows::bytes() const
+{
+	return sizeof(CachedRows) 
+		+ data_.capacity() 
+		+ offsets_.capacity()*sizeof(uint32_t) 
+		+ nulls_.size()/8 
+		+ columns_.size()*sizeof(Retval);
+}
+
+void CachedRows::load(size_t row, int col, Retval& r, const std::shared_ptr<const void>& owner) const
+{
+	size_t cell = row*columns_.size()+col;
+	if(nulls_[cell])
+	{
+		r.assign(nullptr,0);
+		return;
+	}
+	r.unpack( data_.data() + offsets_[cell], offsets_[cell+1] - offsets_[cell], owner );
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+cached_result::cached_result(CachedRows::Ptr rows)
+	: rows_(rows), row_(rows->columns()), next_(0)
+{}
+
+bool cached_result::fetch()
+{
+	if( next_ >= rows_->rows() )
+	{
+		return false;
+	}
+
+	for ( int i = 0; i < (int)row_.size(); i++)
+	{
+		rows_->load(next_,i,row_[i],rows_);
+	}
+	next_++;
+	return true;
+}
+
+const Retval& cached_result::field(int i) const
+{
+	return row_[i];
+}
+
+const Retval& cached_result::field(const std::string& name) const
+{
+	for ( auto& r : row_)
+	{
+		if( r.name() == name ) {
+			return r;
+		}
+	}
+	throw repro::Ex("unknown SQL field");
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+ResultCache::ResultCache(size_t max_bytes)
+	: max_bytes_(max_bytes), bytes_(0)
+{}
+
+void ResultCache::append(std::string& k, const std::string& s)
+{
+	// length prefixed, so values cannot run into each other
+	k.push_back('\x1e');
+	k.append(std::to_string(s.size()));
+	k.push_back(':');
+	k.append(s);
+}
+
+void ResultCache::append(std::string& k, const char* s)
+{
+	append(k,std::string(s));
+}
+
+void ResultCache::append(std::string& k, const MYSQL_TIME& t)
+{
+	// the fields, not the struct bytes, padding and time zone
+	// displacement would tell equal values apart
+	enum_field_types type = MYSQL_TYPE_DATETIME;
+	if ( t.time_type == MYSQL_TIMESTAMP_DATE )
+	{
+		type = MYSQL_TYPE_DATE;
+	}
+	else if ( t.time_type == MYSQL_TIMESTAMP_TIME )
+	{
+		type = MYSQL_TYPE_TIME;
+	}
+
+	k.push_back('\x1d');
+	k.append(std::to_string((int)t.time_type));
+	k.push_back(':');
+	k.append(datetime::format(t,type));
+}
+
+void ResultCache::append(std::string& k, datetime::clock::time_point tp)
+{
+	append(k,datetime::from_time_point(tp));
+}
+
+// tables follow FROM, JOIN, INTO, UPDATE and TABLE. comma separated
+// FROM lists are followed, derived tables are skipped. schema prefixes
+// are dropped, so tags are plain table names.
+
+std::vector<std::string> ResultCache::tables(const std::string& sql)
+{
+	std::vector<std::string> tokens;
+	size_t i = 0;
+	size_t n = sql.size();
+	while( i < n )
+	{
+		char c = sql[i];
+		if( isspace((unsigned char)c) )
+		{
+			i++;
+		}
+		else if( c == '\'' || c == '"' )
+		{
+			// skip string literals
+			i++;
+			while( i < n && sql[i] != c )
+			{
+				if( sql[i] == '\\' ) i++;
+				i++;
+			}
+			i++;
+			tokens.push_back("?");
+		}
+		else if( c == '`' || isalnum((unsigned char)c) || c == '_' || c == '$' )
+		{
+			std::string token;
+			while( i < n && (sql[i] == '`' || sql[i] == '.' || isalnum((unsigned char)sql[i]) || sql[i] == '_' || sql[i] == '$') )
+			{
+				if( sql[i] != '`' ) 
+				{
+					token.push_back( (char)tolower((unsigned char)sql[i]) );
+				}
+				i++;
+			}
+			tokens.push_back(token);
+		}
+		else
+		{
+			tokens.push_back(std::string(1,c));
+			i++;
+		}
+	}
+
+	auto keyword = [](const std::string& t)
+	{
+		return t == "from" || t == "join" || t == "into" || t == "update" || t == "table";
+	};
+	auto ends = [](const std::string& t)
+	{
+		static const char* words[] = { "where", "join", "on", "using", "group", "order", "limit", 
+			"having", "set", "values", "value", "select", "left", "right", "inner", "outer", 
+			"cross", "natural", "straight_join", "union", "for", "lock", "window", "partition", "(", ")", ";" };
+		for( const char* w : words)
+		{
+			if( t == w ) return true;
+		}
+		return false;
+	};
+
+	std::vector<std::string> result;
+	for( size_t t = 0; t < tokens.size(); t++)
+	{
+		if( !keyword(tokens[t]) )
+		{
+			continue;
+		}
+
+		bool list = tokens[t] == "from" || tokens[t] == "update";
+		size_t j = t+1;
+		while( j < tokens.size() && !ends(tokens[j]) && tokens[j] != "," && tokens[j] != "?" )
+		{
+			std::string name = tokens[j];
+			size_t dot = name.rfind('.');
+			if( dot != std::string::npos )
+			{
+				name = name.substr(dot+1);
+			}
+			if( !name.empty() && std::find(result.begin(),result.end(),name) == result.end() )
+			{
+				result.push_back(name);
+			}
+
+			if(!list)
+			{
+				break;
+			}
+
+			// skip an alias, continue after a comma
+			j++;
+			while( j < tokens.size() && !ends(tokens[j]) && tokens[j] != "," )
+			{
+				j++;
+			}
+			if( j >= tokens.size() || tokens[j] != "," )
+			{
+				break;
+			}
+			j++;
+		}
+	}
+	return result;
+}
+
+CachedRows::Ptr ResultCache::get(const std::string& key)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	auto it = entries_.find(key);
+	if( it == entries_.end() )
+	{
+		stats_.misses++;
+		return nullptr;
+	}
+
+	if( it->second.expires <= clock::now() )
+	{
+		erase(it);
+		stats_.misses++;
+		return nullptr;
+	}
+
+	lru_.splice(lru_.begin(),lru_,it->second.lru);
+	stats_.hits++;
+	return it->second.rows;
+}
+
+bool ResultCache::wait(const std::string& key, Waiter w)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	auto it = waiting_.find(key);
+	if( it == waiting_.end() )
+	{
+		waiting_[key].push_back(w);
+		return true;
+	}
+
+	stats_.coalesced++;
+	it->second.push_back(w);
+	return false;
+}
+
+uint64_t ResultCache::stamp(const std::vector<std::string>& tags)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	uint64_t s = 0;
+	for( auto& tag : tags)
+	{
+		auto it = generations_.find(tag);
+		if( it != generations_.end() )
+		{
+			s += it->second;
+		}
+	}
+	return s;
+}
+
+void ResultCache::complete(const std::string& key, std::shared_ptr<CachedRows> rows, const std::vector<std::string>& tags, uint64_t stamp, clock::duration ttl)
+{
+	std::vector<Waiter> waiters;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+
+		auto w = waiting_.find(key);
+		if( w != waiting_.end() )
+		{
+			waiters.swap(w->second);
+			waiting_.erase(w);
+		}
+
+		uint64_t now = 0;
+		for( auto& tag : tags)
+		{
+			auto it = generations_.find(tag);
+			if( it != generations_.end() )
+			{
+				now += it->second;
+			}
+		}
+
+		// a write raced the query, the rows may already be stale
+		size_t size = rows->bytes() + key.size();
+		if( now == stamp && size <= max_bytes_ )
+		{
+			auto it = entries_.find(key);
+			if( it != entries_.end() )
+			{
+				erase(it);
+			}
+
+			lru_.push_front(key);
+			entries_[key] = Entry{ rows, clock::now() + ttl, tags, lru_.begin() };
+			for( auto& tag : tags)
+			{
+				tagged_[tag].insert(key);
+			}
+			bytes_ += size;
+			evict();
+		}
+	}
+
+	for( auto& w : waiters)
+	{
+		w.resolve( std::make_shared<cached_result>(rows) );
+	}
+}
+
+void ResultCache::fail(const std::string& key, const std::exception_ptr ex)
+{
+	std::vector<Waiter> waiters;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+
+		auto w = waiting_.find(key);
+		if( w != waiting_.end() )
+		{
+			waiters.swap(w->second);
+			waiting_.erase(w);
+		}
+	}
+
+	for( auto& w : waiters)
+	{
+		w.reject(ex);
+	}
+}
+
+void ResultCache::invalidate(const std::string& table)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	generations_[table]++;
+	stats_.invalidations++;
+
+	auto it = tagged_.find(table);
+	if( it == tagged_.end() )
+	{
+		return;
+	}
+
+	std::unordered_set<std::string> keys;
+	keys.swap(it->second);
+	for( auto& key : keys)
+	{
+		auto e = entries_.find(key);
+		if( e != entries_.end() )
+		{
+			erase(e);
+		}
+	}
+}
+
+void ResultCache::clear()
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	entries_.clear();
+	lru_.clear();
+	tagged_.clear();
+	bytes_ = 0;
+}
+
+ResultCache::Stats ResultCache::stats() const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	Stats s = stats_;
+	s.entries = entries_.size();
+	s.bytes = bytes_;
+	return s;
+}
+
+// called with mutex_ held
+
+void ResultCache::erase(std::unordered_map<std::string,Entry>::iterator it)
+{
+	for( auto& tag : it->second.tags)
+	{
+		auto t = tagged_.find(tag);
+		if( t != tagged_.end() )
+		{
+			t->second.erase(it->first);
+			if( t->second.empty() )
+			{
+				tagged_.erase(t);
+			}
+		}
+	}
+
+	bytes_ -= it->second.rows->bytes() + it->first.size();
+	lru_.erase(it->second.lru);
+	entries_.erase(it);
+}
+
+void ResultCache::evict()
+{
+	while( bytes_ > max_bytes_ && !lru_.empty() )
+	{
+		auto it = entries_.find(lru_.back());
+		erase(it);
+		stats_.evictions++;
+	}
+}
+
+}
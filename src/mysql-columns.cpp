@@ -0,0 +1,347 @@
+#include "repromysql/mysql-columns.h"
+#include <sstream>
+
+namespace repromysql {
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+static bool is_temporal(enum_field_types type)
+{
+	switch(type)
+	{
+		case MYSQL_TYPE_DATE:
+		case MYSQL_TYPE_TIME:
+		case MYSQL_TYPE_DATETIME:
+		case MYSQL_TYPE_TIMESTAMP:
+		{
+			return true;
+		}
+		default:
+		{
+			return false;
+		}
+	}
+}
+
+static result_columns::Kind kind_of(enum_field_types type)
+{
+	if ( is_temporal(type) )
+	{
+		return result_columns::INT64;
+	}
+
+	switch(type)
+	{
+		case MYSQL_TYPE_TINY:
+		case MYSQL_TYPE_SHORT:
+		case MYSQL_TYPE_LONG:
+		case MYSQL_TYPE_INT24:
+		case MYSQL_TYPE_LONGLONG:
+		case MYSQL_TYPE_YEAR:
+		case MYSQL_TYPE_NULL:
+		{
+			return result_columns::INT64;
+		}
+		case MYSQL_TYPE_FLOAT:
+		case MYSQL_TYPE_DOUBLE:
+		case MYSQL_TYPE_DECIMAL:
+		case MYSQL_TYPE_NEWDECIMAL:
+		{
+			return result_columns::DOUBLE;
+		}
+		default:
+		{
+			return result_columns::STRING;
+		}
+	}
+}
+
+result_columns::result_columns()
+	: rows_(0)
+{}
+
+const result_columns::Column& result_columns::column(const std::string& name) const
+{
+	for ( auto& c : columns_)
+	{
+		if ( c.name == name )
+		{
+			return c;
+		}
+	}
+	throw repro::Ex("unknown SQL field");
+}
+
+void result_columns::init(MYSQL_RES* meta, size_t rows)
+{
+	int n = meta ? (int)mysql_num_fields(meta) : 0;
+
+	columns_.clear();
+	columns_.resize(n);
+	rows_ = 0;
+
+	for ( int i = 0; i < n; i++)
+	{
+		MYSQL_FIELD* field = mysql_fetch_field_direct(meta, i);
+		Column& c = columns_[i];
+
+		c.name = field->name;
+		c.type = field->type;
+		c.kind = kind_of(field->type);
+		c.is_unsigned = (field->flags & UNSIGNED_FLAG) != 0;
+
+		switch(c.kind)
+		{
+			case INT64:  c.ints.reserve(rows); break;
+			case DOUBLE: c.doubles.reserve(rows); break;
+			case STRING:
+			{
+				c.offsets.reserve(rows+1);
+				c.offsets.push_back(0);
+				break;
+			}
+		}
+		c.nulls.reserve( (rows+63)/64 );
+	}
+}
+
+// room for the null bit of row rows_, cleared
+void result_columns::next_row()
+{
+	if ( rows_ % 64 == 0 )
+	{
+		for ( auto& c : columns_)
+		{
+			c.nulls.push_back(0);
+		}
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+// what the client library converts one column into
+struct Cell
+{
+	long long intval;
+	double doubleval;
+	MYSQL_TIME timeval;
+	std::vector<char> buf;
+	unsigned long length;
+	mybool is_null;
+	mybool is_err;
+};
+
+}
+
+void result_columns::load(MYSQL_STMT* st, MYSQL_RES* meta)
+{
+	init(meta, (size_t)mysql_stmt_num_rows(st));
+
+	int n = (int)columns_.size();
+	if ( n == 0 )
+	{
+		return;
+	}
+
+	std::vector<Cell> cells(n);
+	std::vector<MYSQL_BIND> binds(n);
+	memset(binds.data(),0,sizeof(MYSQL_BIND)*n);
+
+	for ( int i = 0; i < n; i++)
+	{
+		Column& c = columns_[i];
+		Cell& cell = cells[i];
+		MYSQL_BIND& b = binds[i];
+
+		b.length = &cell.length;
+		b.is_null = &cell.is_null;
+		b.error = &cell.is_err;
+
+		if ( is_temporal(c.type) )
+		{
+			b.buffer_type = c.type;
+			b.buffer = &cell.timeval;
+			b.buffer_length = sizeof(MYSQL_TIME);
+			continue;
+		}
+
+		switch(c.kind)
+		{
+			case INT64:
+			{
+				b.buffer_type = MYSQL_TYPE_LONGLONG;
+				b.buffer = &cell.intval;
+				b.buffer_length = sizeof(long long);
+				b.is_unsigned = c.is_unsigned;
+				break;
+			}
+			case DOUBLE:
+			{
+				b.buffer_type = MYSQL_TYPE_DOUBLE;
+				b.buffer = &cell.doubleval;
+				b.buffer_length = sizeof(double);
+				break;
+			}
+			case STRING:
+			{
+				// longer values are fetched straight into data.
+				// only stored results know their widest value
+				MYSQL_FIELD* field = mysql_fetch_field_direct(meta,i);
+				cell.buf.resize( Retval::buffer_size(field,field->max_length > 0) + 1 );
+				b.buffer_type = MYSQL_TYPE_BLOB;
+				b.buffer = cell.buf.data();
+				b.buffer_length = cell.buf.size();
+				break;
+			}
+		}
+	}
+
+	if ( mysql_stmt_bind_result(st, binds.data()) )
+	{
+		throw repro::Ex("mysql_stmt_bind_result failed!");
+	}
+
+	while(true)
+	{
+		int rc = mysql_stmt_fetch(st);
+		if ( rc == MYSQL_NO_DATA )
+		{
+			break;
+		}
+		if ( rc == 1 )
+		{
+			std::ostringstream oss;
+			oss << "mysql_stmt_fetch failed: " << mysql_stmt_error(st);
+			throw repro::Ex(oss.str());
+		}
+
+		next_row();
+
+		for ( int i = 0; i < n; i++)
+		{
+			Column& c = columns_[i];
+			Cell& cell = cells[i];
+
+			if ( cell.is_null )
+			{
+				c.nulls[rows_/64] |= 1ULL << (rows_%64);
+			}
+
+			switch(c.kind)
+			{
+				case INT64:
+				{
+					long long v = 0;
+					if ( !cell.is_null )
+					{
+						v = is_temporal(c.type) ? datetime::micros(cell.timeval) : cell.intval;
+					}
+					c.ints.push_back(v);
+					break;
+				}
+				case DOUBLE:
+				{
+					c.doubles.push_back( cell.is_null ? 0.0 : cell.doubleval );
+					break;
+				}
+				case STRING:
+				{
+					size_t at = c.data.size();
+					unsigned long len = cell.is_null ? 0 : cell.length;
+					c.data.resize(at+len);
+
+					if ( len > cell.buf.size() )
+					{
+						MYSQL_BIND b;
+						memset(&b,0,sizeof(MYSQL_BIND));
+						b.buffer_type = MYSQL_TYPE_BLOB;
+						b.buffer = c.data.data()+at;
+						b.buffer_length = len;
+
+						if ( mysql_stmt_fetch_column(st, &b, i, 0) )
+						{
+							std::ostringstream oss;
+							oss << "mysql_stmt_fetch_column failed: " << mysql_stmt_error(st);
+							throw repro::Ex(oss.str());
+						}
+					}
+					else if ( len > 0 )
+					{
+						memcpy(c.data.data()+at, cell.buf.data(), len);
+					}
+					c.offsets.push_back(c.data.size());
+					break;
+				}
+			}
+		}
+		rows_++;
+	}
+}
+
+static long long parse_int(const result_columns::Column& c, std::string_view s)
+{
+	if ( is_temporal(c.type) )
+	{
+		MYSQL_TIME t;
+		return datetime::parse(s,t) ? datetime::micros(t) : 0;
+	}
+	if ( c.is_unsigned )
+	{
+		return (long long)convert::parse<unsigned long long>(s);
+	}
+	return convert::parse<long long>(s);
+}
+
+void result_columns::load(MYSQL_RES* res)
+{
+	init(res, res ? (size_t)mysql_num_rows(res) : 0);
+
+	int n = (int)columns_.size();
+	if ( n == 0 )
+	{
+		return;
+	}
+
+	while( MYSQL_ROW row = mysql_fetch_row(res) )
+	{
+		unsigned long* lengths = mysql_fetch_lengths(res);
+
+		next_row();
+
+		for ( int i = 0; i < n; i++)
+		{
+			Column& c = columns_[i];
+			std::string_view s(row[i] ? row[i] : "", row[i] ? lengths[i] : 0);
+
+			if ( !row[i] )
+			{
+				c.nulls[rows_/64] |= 1ULL << (rows_%64);
+			}
+
+			switch(c.kind)
+			{
+				case INT64:
+				{
+					c.ints.push_back( row[i] ? parse_int(c,s) : 0 );
+					break;
+				}
+				case DOUBLE:
+				{
+					c.doubles.push_back( row[i] ? convert::parse<double>(s) : 0.0 );
+					break;
+				}
+				case STRING:
+				{
+					c.data.insert(c.data.end(), s.begin(), s.end());
+					c.offsets.push_back(c.data.size());
+					break;
+				}
+			}
+		}
+		rows_++;
+	}
+}
+
+}
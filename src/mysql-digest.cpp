@@ -0,0 +1,302 @@
+#include "repromysql/mysql-digest.h"
+#include <cctype>
+#include <cstring>
+
+namespace repromysql {
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+static bool ends_with(const std::string& s, const char* suffix)
+{
+	size_t n = strlen(suffix);
+	return s.size() >= n && s.compare(s.size()-n, n, suffix) == 0;
+}
+
+static bool is_word(char c)
+{
+	return isalnum((unsigned char)c) || c == '_' || c == '$';
+}
+
+DigestStats::DigestStats(size_t max_digests)
+	: max_per_shard_( max_digests/shards + 1 )
+{}
+
+std::string DigestStats::normalize(const std::string& sql)
+{
+	std::string out;
+	out.reserve(sql.size());
+
+	bool space = false;
+	size_t i = 0;
+	size_t n = sql.size();
+
+	auto emit = [&out,&space](char c)
+	{
+		if ( space && !out.empty() && out.back() != '(' && out.back() != ',' && c != ')' && c != ',' )
+		{
+			out.push_back(' ');
+		}
+		space = false;
+		out.push_back(c);
+	};
+
+	// ?,? folds into ?
+	auto param = [&out,&space,&emit]()
+	{
+		if ( ends_with(out,"?,") )
+		{
+			out.pop_back();
+			space = false;
+			return;
+		}
+		emit('?');
+	};
+
+	while ( i < n )
+	{
+		char c = sql[i];
+
+		if ( isspace((unsigned char)c) )
+		{
+			space = true;
+			i++;
+			continue;
+		}
+
+		// comments
+		if ( c == '#' || ( c == '-' && i+2 < n && sql[i+1] == '-' && isspace((unsigned char)sql[i+2]) ) )
+		{
+			while ( i < n && sql[i] != '\n' ) i++;
+			space = true;
+			continue;
+		}
+		if ( c == '/' && i+1 < n && sql[i+1] == '*' )
+		{
+			i += 2;
+			while ( i+1 < n && !(sql[i] == '*' && sql[i+1] == '/') ) i++;
+			i += 2;
+			space = true;
+			continue;
+		}
+
+		// string literals
+		if ( c == '\'' || c == '"' )
+		{
+			i++;
+			while ( i < n )
+			{
+				if ( sql[i] == '\\' ) 
+				{
+					i += 2;
+					continue;
+				}
+				if ( sql[i] == c )
+				{
+					if ( i+1 < n && sql[i+1] == c )
+					{
+						i += 2;
+						continue;
+					}
+					break;
+				}
+				i++;
+			}
+			i++;
+			param();
+			continue;
+		}
+
+		// quoted identifiers stay
+		if ( c == '`' )
+		{
+			size_t end = sql.find('`',i+1);
+			end = end == std::string::npos ? n : end+1;
+			emit('`');
+			out.append(sql, i+1, end-i-1);
+			i = end;
+			continue;
+		}
+
+		// numbers, unless part of an identifier
+		if ( isdigit((unsigned char)c) && ( out.empty() || space || !is_word(out.back()) ) )
+		{
+			while ( i < n && ( is_word(sql[i]) || sql[i] == '.' ) ) i++;
+			param();
+			continue;
+		}
+
+		if ( c == '?' )
+		{
+			i++;
+			param();
+			continue;
+		}
+
+		// (?),(?) folds into (?)
+		if ( c == ')' && ends_with(out,"(?") )
+		{
+			std::string before = out.substr(0,out.size()-2);
+			if ( ends_with(before,"(?),") )
+			{
+				out = before.substr(0,before.size()-1);
+				space = false;
+				i++;
+				continue;
+			}
+		}
+
+		if ( c == ';' )
+		{
+			i++;
+			continue;
+		}
+
+		emit(c);
+		i++;
+	}
+
+	return out;
+}
+
+uint64_t DigestStats::fingerprint(const std::string& sql)
+{
+	std::string text = normalize(sql);
+
+	// FNV-1a
+	uint64_t h = 14695981039346656037ull;
+	for( unsigned char c : text)
+	{
+		h ^= c;
+		h *= 1099511628211ull;
+	}
+	return h ? h : 1;
+}
+
+void DigestStats::record(uint64_t id, const std::string& sql, clock::duration d, long long rows, bool error)
+{
+	auto us = std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+	size_t bucket = 0;
+	while ( bucket < buckets-1 && us > (1ll << bucket) )
+	{
+		bucket++;
+	}
+
+	{
+		Shard& shard = shards_[id % shards];
+		std::lock_guard<std::mutex> lock(shard.mutex);
+
+		auto it = shard.map.find(id);
+		if ( it == shard.map.end() && shard.map.size() < max_per_shard_ )
+		{
+			it = shard.map.insert( std::make_pair(id,Entry()) ).first;
+			it->second.text = normalize(sql);
+		}
+		if ( it != shard.map.end() )
+		{
+			add(it->second,d,rows,error,bucket);
+			return;
+		}
+	}
+
+	// the shard is full, every overflow goes into the one digest 0
+	std::lock_guard<std::mutex> lock(overflow_.mutex);
+
+	Entry& e = overflow_.map[0];
+	if ( e.text.empty() )
+	{
+		e.text = "<other>";
+	}
+	add(e,d,rows,error,bucket);
+}
+
+void DigestStats::add(Entry& e, clock::duration d, long long rows, bool error, size_t bucket)
+{
+	e.calls++;
+	if(error)
+	{
+		e.errors++;
+	}
+	if ( rows > 0 )
+	{
+		e.rows += rows;
+	}
+	e.total += d;
+	e.min = std::min(e.min,d);
+	e.max = std::max(e.max,d);
+	e.histogram[bucket]++;
+}
+
+std::vector<Digest> DigestStats::dump(bool reset)
+{
+	auto seconds = [](clock::duration d)
+	{
+		return std::chrono::duration<double>(d).count();
+	};
+
+	std::vector<Digest> result;
+
+	for( size_t s = 0; s <= shards; s++)
+	{
+		Shard& shard = s < shards ? shards_[s] : overflow_;
+
+		std::unordered_map<uint64_t,Entry> map;
+		{
+			std::lock_guard<std::mutex> lock(shard.mutex);
+			if(reset)
+			{
+				map.swap(shard.map);
+			}
+			else
+			{
+				map = shard.map;
+			}
+		}
+
+		for( auto& it : map)
+		{
+			const Entry& e = it.second;
+
+			Digest d;
+			d.id = it.first;
+			d.text = e.text;
+			d.calls = e.calls;
+			d.errors = e.errors;
+			d.rows = e.rows;
+			d.total = seconds(e.total);
+			d.min = e.calls ? seconds(e.min) : 0;
+			d.max = seconds(e.max);
+
+			unsigned long long rank = (unsigned long long)(0.99 * (e.calls-1)) + 1;
+			unsigned long long seen = 0;
+			for( size_t b = 0; b < buckets; b++)
+			{
+				seen += e.histogram[b];
+				if ( seen >= rank )
+				{
+					d.p99 = (double)(1ll << b) / 1000000.0;
+					break;
+				}
+			}
+
+			result.push_back(d);
+		}
+	}
+
+	return result;
+}
+
+void DigestStats::reset()
+{
+	for( size_t s = 0; s < shards; s++)
+	{
+		std::lock_guard<std::mutex> lock(shards_[s].mutex);
+		shards_[s].map.clear();
+	}
+
+	std::lock_guard<std::mutex> lock(overflow_.mutex);
+	overflow_.map.clear();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+}
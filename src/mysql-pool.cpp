@@ -0,0 +1,693 @@
+#include "repromysql/mysql-pool.h"
+#include "repromysql/mysql-async.h"
+#include <limits>
+
+namespace repromysql {
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+double PoolStats::bound(size_t i)
+{
+	if ( i >= buckets-1 )
+	{
+		return std::numeric_limits<double>::infinity();
+	}
+	return (double)(1ll << i);
+}
+
+double PoolStats::wait_percentile(double p) const
+{
+	unsigned long long n = 0;
+	for( size_t i = 0; i < buckets; i++)
+	{
+		n += wait[i];
+	}
+	if ( n == 0 )
+	{
+		return 0;
+	}
+
+	unsigned long long rank = (unsigned long long)(p * (n-1)) + 1;
+	unsigned long long seen = 0;
+	for( size_t i = 0; i < buckets; i++)
+	{
+		seen += wait[i];
+		if ( seen >= rank )
+		{
+			return bound(i);
+		}
+	}
+	return bound(buckets-1);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+struct ConnectionPool::Releaser
+{
+	std::weak_ptr<ConnectionPool> pool;
+	ConnectionPtr con;
+
+	void operator()(MYSQL*)
+	{
+		auto p = pool.lock();
+		if(p)
+		{
+			p->release(con);
+		}
+		else
+		{
+			MysqlLocator::free(con->con);
+		}
+	}
+};
+
+ConnectionPool::ConnectionPool(const std::string& url, size_t capacity)
+	: url_(url), 
+	  capacity_(capacity), 
+	  min_idle_(0), 
+	  total_(0), 
+	  filling_(0), 
+	  pinging_(0),
+	  shutdown_(false),
+	  retrying_(false),
+	  scheduled_(false),
+	  keepalive_(clock::duration::zero()),
+	  idle_timeout_(clock::duration::zero()),
+	  max_lifetime_(clock::duration::zero()),
+	  random_(std::random_device()()),
+	  borrowed_(0),
+	  acquired_(0),
+	  created_(0),
+	  destroyed_(0),
+	  invalidated_(0),
+	  failed_(0),
+	  wait_(),
+	  wait_total_(clock::duration::zero())
+{}
+
+ConnectionPool::~ConnectionPool()
+{
+	for( auto& c : idle_)
+	{
+		MysqlLocator::free(c->con);
+	}
+}
+
+repro::Future<ConnectionPool::ResourcePtr> ConnectionPool::get()
+{
+	auto p = repro::promise<ResourcePtr>();
+	auto since = clock::now();
+
+	ConnectionPtr c;
+	bool open = false;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+
+		if(shutdown_)
+		{
+			p.reject(repro::Ex("connection pool is shut down"));
+			return p.future();
+		}
+
+		if(!idle_.empty())
+		{
+			c = idle_.front();
+			idle_.pop_front();
+		}
+		else if ( total_ < capacity_ )
+		{
+			total_++;
+			open = true;
+		}
+		else
+		{
+			waiters_.push_back( Waiter{p,since} );
+		}
+	}
+
+	if(c)
+	{
+		p.resolve(wrap(c,since));
+		fill();
+	}
+	else if(open)
+	{
+		this->open(p,since);
+	}
+
+	return p.future();
+}
+
+void ConnectionPool::shutdown()
+{
+	std::list<ConnectionPtr> idle;
+	Waiters waiters;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+
+		shutdown_ = true;
+		total_ -= idle_.size();
+		destroyed_ += idle_.size();
+		idle.swap(idle_);
+		waiters.swap(waiters_);
+	}
+
+	for( auto& c : idle)
+	{
+		MysqlLocator::free(c->con);
+	}
+
+	for( auto& w : waiters)
+	{
+		w.p.reject(repro::Ex("connection pool is shut down"));
+	}
+}
+
+repro::Future<> ConnectionPool::prewarm(size_t n)
+{
+	auto p = repro::promise<>();
+
+	size_t count = 0;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+
+		min_idle_ = std::min(n,capacity_);
+
+		size_t have = idle_.size() + filling_ + pinging_;
+		if ( !shutdown_ && have < min_idle_ )
+		{
+			count = std::min(min_idle_ - have, capacity_ - total_);
+			total_ += count;
+			filling_ += count;
+		}
+	}
+
+	if ( count == 0 )
+	{
+		prio::nextTick( [p]()
+		{
+			p.resolve();
+		});
+		return p.future();
+	}
+
+	// resolve when all opens settled, reject with the first failure
+	auto pending = std::make_shared<std::pair<size_t,std::exception_ptr>>(count,nullptr);
+
+	auto settle = [p,pending]()
+	{
+		if ( --pending->first > 0 ) return;
+
+		if(pending->second)
+		{
+			p.reject(pending->second);
+		}
+		else
+		{
+			p.resolve();
+		}
+	};
+
+	for( size_t i = 0; i < count; i++)
+	{
+		spawn()
+		.then(settle)
+		.otherwise( [pending,settle](const std::exception_ptr ex)
+		{
+			if(!pending->second)
+			{
+				pending->second = ex;
+			}
+			settle();
+		});
+	}
+
+	return p.future();
+}
+
+void ConnectionPool::keepalive(int secs)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		keepalive_ = std::chrono::seconds(secs);
+	}
+	schedule();
+}
+
+void ConnectionPool::idle_timeout(int secs)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		idle_timeout_ = std::chrono::seconds(secs);
+	}
+	schedule();
+}
+
+void ConnectionPool::max_lifetime(int secs)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		max_lifetime_ = std::chrono::seconds(secs);
+	}
+	schedule();
+}
+
+void ConnectionPool::invalidate(ResourcePtr& r)
+{
+	Releaser* d = std::get_deleter<Releaser>(r);
+	if(d)
+	{
+		d->con->invalid = true;
+	}
+}
+
+PoolStats ConnectionPool::stats() const
+{
+	PoolStats s;
+
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	s.capacity = capacity_;
+	s.total = total_;
+	s.in_use = borrowed_;
+	s.idle = idle_.size();
+	s.opening = total_ - borrowed_ - idle_.size() - pinging_;
+	s.waiting = waiters_.size();
+
+	s.acquired = acquired_;
+	s.created = created_;
+	s.destroyed = destroyed_;
+	s.invalidated = invalidated_;
+	s.failed = failed_;
+
+	for( size_t i = 0; i < PoolStats::buckets; i++)
+	{
+		s.wait[i] = wait_[i];
+	}
+	s.wait_total = std::chrono::duration<double>(wait_total_).count();
+
+	return s;
+}
+
+// hands out a connection and records how long the borrower waited
+
+ConnectionPool::ResourcePtr ConnectionPool::wrap(ConnectionPtr c, clock::time_point since)
+{
+	auto wait = clock::now() - since;
+	auto us = std::chrono::duration_cast<std::chrono::microseconds>(wait).count();
+
+	size_t bucket = 0;
+	while ( bucket < PoolStats::buckets-1 && us > (1ll << bucket) )
+	{
+		bucket++;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+
+		borrowed_++;
+		acquired_++;
+		wait_[bucket]++;
+		wait_total_ += wait;
+	}
+
+	return ResourcePtr(c->con, Releaser{ shared_from_this(), c });
+}
+
+ConnectionPool::ConnectionPtr ConnectionPool::track(MYSQL* m)
+{
+	std::uniform_real_distribution<double> dist(0.0,0.1);
+	double jitter = 0;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		jitter = dist(random_);
+		created_++;
+	}
+
+	auto now = clock::now();
+	return std::make_shared<Connection>( Connection{ m, now, now, now, false, jitter } );
+}
+
+// opens a connection for a borrower, capacity already reserved
+
+void ConnectionPool::open(repro::Promise<ResourcePtr> p, clock::time_point since)
+{
+	auto self = shared_from_this();
+
+	MysqlLocator::retrieve(url_)
+	.then( [self,p,since](MYSQL* m)
+	{
+		p.resolve(self->wrap(self->track(m),since));
+	})
+	.otherwise( [self,p](const std::exception_ptr ex)
+	{
+		{
+			std::lock_guard<std::mutex> lock(self->mutex_);
+			self->total_--;
+			self->failed_++;
+		}
+		self->dropped();
+		p.reject(ex);
+	});
+}
+
+// opens a connection towards the min_idle floor, capacity already reserved
+
+repro::Future<> ConnectionPool::spawn()
+{
+	auto p = repro::promise<>();
+	auto self = shared_from_this();
+
+	MysqlLocator::retrieve(url_)
+	.then( [self,p](MYSQL* m)
+	{
+		{
+			std::lock_guard<std::mutex> lock(self->mutex_);
+			self->filling_--;
+		}
+		self->hand_off(self->track(m));
+		p.resolve();
+	})
+	.otherwise( [self,p](const std::exception_ptr ex)
+	{
+		{
+			std::lock_guard<std::mutex> lock(self->mutex_);
+			self->filling_--;
+			self->total_--;
+			self->failed_++;
+		}
+		self->dropped();
+		self->retry();
+		p.reject(ex);
+	});
+
+	return p.future();
+}
+
+void ConnectionPool::release(ConnectionPtr c)
+{
+	bool drop = false;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+
+		borrowed_--;
+		if ( c->invalid )
+		{
+			invalidated_++;
+		}
+
+		if ( c->invalid || shutdown_ || expired(c,clock::now()) )
+		{
+			total_--;
+			drop = true;
+		}
+	}
+
+	if(!drop)
+	{
+		hand_off(c);
+		return;
+	}
+
+	close(c);
+	dropped();
+	fill();
+}
+
+// serve the oldest waiter or park the connection as idle.
+// waiters are resolved on the next tick, release runs in a deleter
+
+void ConnectionPool::hand_off(ConnectionPtr c, bool used)
+{
+	Waiters next;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+
+		if(shutdown_)
+		{
+			total_--;
+		}
+		else if(waiters_.empty())
+		{
+			if(used)
+			{
+				c->returned = c->checked = clock::now();
+			}
+			idle_.push_front(c);
+			return;
+		}
+		else
+		{
+			next.splice(next.begin(),waiters_,waiters_.begin());
+		}
+	}
+
+	if(next.empty())
+	{
+		close(c);
+		return;
+	}
+
+	auto p = next.front().p;
+	auto r = wrap(c,next.front().since);
+	prio::nextTick( [p,r]()
+	{
+		p.resolve(r);
+	});
+}
+
+// a connection went away, let the next waiter open a new one
+
+void ConnectionPool::dropped()
+{
+	Waiters next;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+
+		if ( shutdown_ || waiters_.empty() || total_ >= capacity_ )
+		{
+			return;
+		}
+
+		total_++;
+		next.splice(next.begin(),waiters_,waiters_.begin());
+	}
+
+	open(next.front().p,next.front().since);
+}
+
+void ConnectionPool::fill()
+{
+	size_t count = 0;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+
+		size_t have = idle_.size() + filling_ + pinging_;
+		if ( shutdown_ || retrying_ || have >= min_idle_ )
+		{
+			return;
+		}
+
+		count = std::min(min_idle_ - have, capacity_ - total_);
+		total_ += count;
+		filling_ += count;
+	}
+
+	for( size_t i = 0; i < count; i++)
+	{
+		spawn();
+	}
+}
+
+// back off after a failed open instead of hammering the server
+
+void ConnectionPool::retry()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+
+		if ( shutdown_ || retrying_ )
+		{
+			return;
+		}
+		retrying_ = true;
+	}
+
+	std::weak_ptr<ConnectionPool> weak = shared_from_this();
+	prio::timeout( [weak]()
+	{
+		auto self = weak.lock();
+		if(!self) return;
+
+		{
+			std::lock_guard<std::mutex> lock(self->mutex_);
+			self->retrying_ = false;
+		}
+		self->fill();
+	},1,0);
+}
+
+bool ConnectionPool::expired(const ConnectionPtr& c, clock::time_point now) const
+{
+	if ( max_lifetime_ == clock::duration::zero() )
+	{
+		return false;
+	}
+
+	auto lifetime = std::chrono::duration_cast<clock::duration>(max_lifetime_ * (1.0 - c->jitter));
+	return now - c->created >= lifetime;
+}
+
+// closing sends COM_QUIT, keep that off the event loop
+
+void ConnectionPool::close(ConnectionPtr c)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		destroyed_++;
+	}
+
+	MYSQL* m = c->con;
+	prio::task( [m]()
+	{
+		MysqlLocator::free(m);
+	});
+}
+
+void ConnectionPool::schedule()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+
+		bool enabled = keepalive_   != clock::duration::zero() ||
+		               idle_timeout_ != clock::duration::zero() ||
+		               max_lifetime_ != clock::duration::zero();
+
+		if ( shutdown_ || scheduled_ || !enabled )
+		{
+			return;
+		}
+		scheduled_ = true;
+	}
+
+	std::weak_ptr<ConnectionPool> weak = shared_from_this();
+	prio::timeout( [weak]()
+	{
+		auto self = weak.lock();
+		if(!self) return;
+
+		{
+			std::lock_guard<std::mutex> lock(self->mutex_);
+			self->scheduled_ = false;
+		}
+		self->housekeeping();
+		self->schedule();
+	},1,0);
+}
+
+// only idle connections are touched. connections being pinged are 
+// taken out of the idle list, so borrowers never wait for a ping.
+// lifetime recycling is capped per run to spread reconnects
+
+void ConnectionPool::housekeeping()
+{
+	std::vector<ConnectionPtr> closing;
+	std::vector<ConnectionPtr> pinging;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+
+		if(shutdown_)
+		{
+			return;
+		}
+
+		auto now = clock::now();
+		size_t recycle = std::max<size_t>(1,capacity_/4);
+
+		// oldest returned sit at the back
+		auto it = idle_.end();
+		while( it != idle_.begin() )
+		{
+			--it;
+			ConnectionPtr c = *it;
+
+			bool drop = false;
+			if ( recycle > 0 && expired(c,now) )
+			{
+				recycle--;
+				drop = true;
+			}
+			else if ( idle_timeout_ != clock::duration::zero() && 
+			          now - c->returned >= idle_timeout_ && 
+			          idle_.size() > min_idle_ )
+			{
+				drop = true;
+			}
+
+			if(drop)
+			{
+				closing.push_back(c);
+				it = idle_.erase(it);
+				total_--;
+			}
+			else if ( keepalive_ != clock::duration::zero() && now - c->checked >= keepalive_ )
+			{
+				pinging.push_back(c);
+				it = idle_.erase(it);
+				pinging_++;
+			}
+		}
+	}
+
+	for( auto& c : closing)
+	{
+		close(c);
+	}
+
+	for( auto& c : pinging)
+	{
+		ping(c);
+	}
+
+	if(!closing.empty())
+	{
+		dropped();
+		fill();
+	}
+}
+
+void ConnectionPool::ping(ConnectionPtr c)
+{
+	auto self = shared_from_this();
+
+	prio::task( [c]()
+	{
+		return mysql_ping(c->con) == 0;
+	})
+	.then( [self,c](bool alive)
+	{
+		{
+			std::lock_guard<std::mutex> lock(self->mutex_);
+			self->pinging_--;
+		}
+
+		if(alive)
+		{
+			c->checked = clock::now();
+			self->hand_off(c,false);
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(self->mutex_);
+			self->total_--;
+		}
+		self->close(c);
+		self->dropped();
+		self->fill();
+	});
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+}
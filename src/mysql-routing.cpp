@@ -0,0 +1,223 @@
+#include "repromysql/mysql-routing.h"
+
+namespace repromysql {
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+// weight of the latest sample in the latency average
+static const double ewma_alpha = 0.2;
+
+RoutingMysqlPool::RoutingMysqlPool(const std::string& primary, const std::vector<std::string>& replicas, int capacity, MysqlPool::Mode mode)
+	: primary_(primary,capacity,mode),
+	  policy_(LEAST_OUTSTANDING),
+	  backoff_(std::chrono::seconds(5)),
+	  wait_(1000),
+	  next_(0)
+{
+	for( auto& url : replicas)
+	{
+		replicas_.push_back(std::make_shared<Replica>(url,capacity,mode));
+	}
+}
+
+repro::Future<std::shared_ptr<mysql_async>> RoutingMysqlPool::con(Route r)
+{
+	auto replica = r == REPLICA ? pick() : nullptr;
+	if(!replica)
+	{
+		return primary_.con();
+	}
+	return replica->pool.con();
+}
+
+RoutingMysqlPool::ReplicaPtr RoutingMysqlPool::read(Route r)
+{
+	if(r == PRIMARY)
+	{
+		return nullptr;
+	}
+	return pick();
+}
+
+RoutingMysqlPool::ReplicaPtr RoutingMysqlPool::write(Route r)
+{
+	if(r == REPLICA)
+	{
+		return pick();
+	}
+	return nullptr;
+}
+
+RoutingMysqlPool::ReplicaPtr RoutingMysqlPool::pick()
+{
+	ReplicaPtr best;
+	double best_cost = 0;
+	auto now = clock::now();
+	size_t n = replicas_.size();
+
+	// start at a rotating offset so ties spread over the replicas
+	for( size_t i = 0; i < n; i++)
+	{
+		auto& replica = replicas_[(next_+i) % n];
+		if(replica->down_until > now)
+		{
+			continue;
+		}
+
+		double cost = (double)replica->outstanding;
+		if(policy_ == EWMA)
+		{
+			cost = replica->ewma * (replica->outstanding+1);
+		}
+
+		if(!best || cost < best_cost)
+		{
+			best = replica;
+			best_cost = cost;
+		}
+	}
+
+	next_++;
+	return best;
+}
+
+repro::Future<mysql_async::Ptr> RoutingMysqlPool::caught_up(ReplicaPtr replica, const std::string& gtid)
+{
+	auto p = repro::promise<mysql_async::Ptr>();
+	double secs = wait_ / 1000.0;
+
+	replica->pool.con()
+	.then( [p,gtid,secs](mysql_async::Ptr m)
+	{
+		// 0 once applied, 1 on timeout
+		m->query("SELECT WAIT_FOR_EXECUTED_GTID_SET(?,?)",gtid,secs)
+		.then( [p,m](result_async::Ptr r)
+		{
+			bool applied = r->fetch() && !r->field(0).null() && r->field(0).getLongLong() == 0;
+			p.resolve( applied ? m : nullptr );
+		})
+		.otherwise( [p](const std::exception_ptr ex)
+		{
+			p.resolve(nullptr);
+		});
+	})
+	.otherwise( [p](const std::exception_ptr ex)
+	{
+		p.resolve(nullptr);
+	});
+
+	return p.future();
+}
+
+void RoutingMysqlPool::done(ReplicaPtr replica, clock::time_point start)
+{
+	double sample = std::chrono::duration<double>(clock::now() - start).count();
+
+	replica->outstanding--;
+	if(replica->ewma == 0)
+	{
+		replica->ewma = sample;
+	}
+	else
+	{
+		replica->ewma += ewma_alpha * (sample - replica->ewma);
+	}
+}
+
+void RoutingMysqlPool::failed(ReplicaPtr replica, clock::duration backoff)
+{
+	replica->outstanding--;
+
+	unsigned long long failures = replica->pool.stats().failed;
+	if(failures > replica->connect_failures)
+	{
+		replica->connect_failures = failures;
+		replica->down_until = clock::now() + backoff;
+	}
+}
+
+repro::Future<> RoutingMysqlPool::prewarm(size_t min_idle)
+{
+	auto p = repro::promise<>();
+	auto pending = std::make_shared<size_t>(replicas_.size()+1);
+	auto failed = std::make_shared<bool>(false);
+
+	auto warm = [p,pending,failed,min_idle](MysqlPool& pool)
+	{
+		pool.prewarm(min_idle)
+		.then( [p,pending,failed]()
+		{
+			if( --(*pending) == 0 && !*failed)
+			{
+				p.resolve();
+			}
+		})
+		.otherwise( [p,pending,failed](const std::exception_ptr ex)
+		{
+			--(*pending);
+			if(!*failed)
+			{
+				*failed = true;
+				p.reject(ex);
+			}
+		});
+	};
+
+	warm(primary_);
+	for( auto& replica : replicas_)
+	{
+		warm(replica->pool);
+	}
+
+	return p.future();
+}
+
+void RoutingMysqlPool::keepalive(int secs)
+{
+	primary_.keepalive(secs);
+	for( auto& replica : replicas_) replica->pool.keepalive(secs);
+}
+
+void RoutingMysqlPool::idle_timeout(int secs)
+{
+	primary_.idle_timeout(secs);
+	for( auto& replica : replicas_) replica->pool.idle_timeout(secs);
+}
+
+void RoutingMysqlPool::max_lifetime(int secs)
+{
+	primary_.max_lifetime(secs);
+	for( auto& replica : replicas_) replica->pool.max_lifetime(secs);
+}
+
+void RoutingMysqlPool::hook(QueryHook::Ptr h)
+{
+	primary_.hook(h);
+	for( auto& replica : replicas_) replica->pool.hook(h);
+}
+
+void RoutingMysqlPool::slow_log(std::shared_ptr<SlowQueryLog> log)
+{
+	primary_.slow_log(log);
+	for( auto& replica : replicas_) replica->pool.slow_log(log);
+}
+
+void RoutingMysqlPool::digests(DigestStats::Ptr d)
+{
+	primary_.digests(d);
+	for( auto& replica : replicas_) replica->pool.digests(d);
+}
+
+void RoutingMysqlPool::statement_cache(size_t n)
+{
+	primary_.statement_cache(n);
+	for( auto& replica : replicas_) replica->pool.statement_cache(n);
+}
+
+void RoutingMysqlPool::shutdown()
+{
+	primary_.shutdown();
+	for( auto& replica : replicas_) replica->pool.shutdown();
+}
+
+}
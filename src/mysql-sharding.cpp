@@ -0,0 +1,196 @@
+#include "repromysql/mysql-sharding.h"
+#include <algorithm>
+
+namespace repromysql {
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+HashRing::HashRing(const std::vector<std::string>& nodes, size_t vnodes)
+{
+	ring_.reserve(nodes.size()*vnodes);
+
+	for ( size_t i = 0; i < nodes.size(); i++)
+	{
+		for ( size_t v = 0; v < vnodes; v++)
+		{
+			ring_.push_back( std::make_pair( hash(nodes[i] + "#" + std::to_string(v)), i ) );
+		}
+	}
+
+	std::sort(ring_.begin(),ring_.end());
+}
+
+size_t HashRing::lookup(const std::string& key) const
+{
+	if(ring_.empty())
+	{
+		throw repro::Ex("empty hash ring");
+	}
+
+	// first virtual node clockwise of the key
+	auto it = std::lower_bound(
+		ring_.begin(), ring_.end(),
+		std::make_pair(hash(key),(size_t)0)
+	);
+
+	if ( it == ring_.end() )
+	{
+		it = ring_.begin();
+	}
+	return it->second;
+}
+
+// FNV-1a with a murmur3 finalizer, fnv alone clusters on short similar keys
+
+uint64_t HashRing::hash(const std::string& s)
+{
+	uint64_t h = 14695981039346656037ULL;
+	for ( unsigned char c : s )
+	{
+		h ^= c;
+		h *= 1099511628211ULL;
+	}
+
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+	return h;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+static std::vector<MysqlPool> make_shards(const std::vector<std::string>& urls, int capacity, MysqlPool::Mode mode)
+{
+	if(urls.empty())
+	{
+		throw repro::Ex("sharded pool needs at least one shard");
+	}
+
+	std::vector<MysqlPool> shards;
+	shards.reserve(urls.size());
+	for( auto& url : urls)
+	{
+		shards.emplace_back(url,capacity,mode);
+	}
+	return shards;
+}
+
+ShardedMysqlPool::ShardedMysqlPool(const std::vector<std::string>& urls, int capacity, MysqlPool::Mode mode, size_t vnodes)
+	: ShardedMysqlPool(urls, [](const std::string& key) { return key; }, capacity, mode, vnodes)
+{}
+
+ShardedMysqlPool::ShardedMysqlPool(const std::vector<std::string>& urls, KeyExtractor extractor, int capacity, MysqlPool::Mode mode, size_t vnodes)
+	: shards_(make_shards(urls,capacity,mode)),
+	  ring_(urls,vnodes),
+	  extractor_(extractor)
+{}
+
+void ShardedMysqlPool::Gather::add(repro::Promise<result_batch::Ptr> p, result_async::Ptr r)
+{
+	pending--;
+	if(failed)
+	{
+		return;
+	}
+
+	if(!batch)
+	{
+		batch = std::make_shared<result_batch>(r->fields());
+	}
+	while(r->fetch())
+	{
+		batch->add(*r);
+	}
+
+	if(pending == 0)
+	{
+		p.resolve(batch);
+	}
+}
+
+void ShardedMysqlPool::Gather::fail(repro::Promise<result_batch::Ptr> p, const std::exception_ptr ex)
+{
+	pending--;
+	if(failed)
+	{
+		return;
+	}
+
+	failed = true;
+	batch.reset();
+	p.reject(ex);
+}
+
+repro::Future<> ShardedMysqlPool::prewarm(size_t min_idle)
+{
+	auto p = repro::promise<>();
+	auto pending = std::make_shared<size_t>(shards_.size());
+	auto failed = std::make_shared<bool>(false);
+
+	for( auto& pool : shards_)
+	{
+		pool.prewarm(min_idle)
+		.then( [p,pending,failed]()
+		{
+			if( --(*pending) == 0 && !*failed)
+			{
+				p.resolve();
+			}
+		})
+		.otherwise( [p,pending,failed](const std::exception_ptr ex)
+		{
+			--(*pending);
+			if(!*failed)
+			{
+				*failed = true;
+				p.reject(ex);
+			}
+		});
+	}
+
+	return p.future();
+}
+
+void ShardedMysqlPool::keepalive(int secs)
+{
+	for( auto& pool : shards_) pool.keepalive(secs);
+}
+
+void ShardedMysqlPool::idle_timeout(int secs)
+{
+	for( auto& pool : shards_) pool.idle_timeout(secs);
+}
+
+void ShardedMysqlPool::max_lifetime(int secs)
+{
+	for( auto& pool : shards_) pool.max_lifetime(secs);
+}
+
+void ShardedMysqlPool::hook(QueryHook::Ptr h)
+{
+	for( auto& pool : shards_) pool.hook(h);
+}
+
+void ShardedMysqlPool::slow_log(std::shared_ptr<SlowQueryLog> log)
+{
+	for( auto& pool : shards_) pool.slow_log(log);
+}
+
+void ShardedMysqlPool::digests(DigestStats::Ptr d)
+{
+	for( auto& pool : shards_) pool.digests(d);
+}
+
+void ShardedMysqlPool::statement_cache(size_t n)
+{
+	for( auto& pool : shards_) pool.statement_cache(n);
+}
+
+void ShardedMysqlPool::shutdown()
+{
+	for( auto& pool : shards_) pool.shutdown();
+}
+
+}
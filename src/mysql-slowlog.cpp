@@ -0,0 +1,329 @@
+#include "repromysql/mysql-slowlog.h"
+#include <cstdio>
+#include <ctime>
+
+namespace repromysql {
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+static const char* type_name(enum_field_types t)
+{
+	switch(t)
+	{
+		case MYSQL_TYPE_TINY : return "TINY";
+		case MYSQL_TYPE_SHORT : return "SHORT";
+		case MYSQL_TYPE_LONG : return "LONG";
+		case MYSQL_TYPE_INT24 : return "INT24";
+		case MYSQL_TYPE_LONGLONG : return "LONGLONG";
+		case MYSQL_TYPE_FLOAT : return "FLOAT";
+		case MYSQL_TYPE_DOUBLE : return "DOUBLE";
+		case MYSQL_TYPE_DECIMAL : return "DECIMAL";
+		case MYSQL_TYPE_NEWDECIMAL : return "NEWDECIMAL";
+		case MYSQL_TYPE_TIME : return "TIME";
+		case MYSQL_TYPE_DATE : return "DATE";
+		case MYSQL_TYPE_DATETIME : return "DATETIME";
+		case MYSQL_TYPE_TIMESTAMP : return "TIMESTAMP";
+		case MYSQL_TYPE_STRING : return "STRING";
+		case MYSQL_TYPE_VAR_STRING : return "VAR_STRING";
+		case MYSQL_TYPE_BLOB : return "BLOB";
+		case MYSQL_TYPE_NULL : return "NULL";
+		default : return "OTHER";
+	}
+}
+
+// index past the comment starting at i, i itself if there is none
+
+static size_t skip_comment(const std::string& sql, size_t i)
+{
+	size_t n = sql.size();
+	if ( sql[i] == '#' || ( sql.compare(i,2,"--") == 0 && ( i+2 == n || isspace((unsigned char)sql[i+2]) ) ) )
+	{
+		size_t e = sql.find('\n',i);
+		return e == std::string::npos ? n : e+1;
+	}
+	if ( sql.compare(i,2,"/*") == 0 )
+	{
+		size_t e = sql.find("*/",i+2);
+		return e == std::string::npos ? n : e+2;
+	}
+	return i;
+}
+
+// only a single SELECT, INSERT, UPDATE, DELETE, REPLACE or TABLE 
+// statement has a plan. transaction control, SET, DDL and multi 
+// statement batches would just fail
+
+static bool explainable(const std::string& sql)
+{
+	size_t n = sql.size();
+	size_t i = 0;
+	while( i < n )
+	{
+		size_t e = skip_comment(sql,i);
+		if ( e != i )
+		{
+			i = e;
+		}
+		else if ( isspace((unsigned char)sql[i]) || sql[i] == '(' )
+		{
+			i++;
+		}
+		else
+		{
+			break;
+		}
+	}
+
+	std::string word;
+	while( i < n && isalpha((unsigned char)sql[i]) )
+	{
+		word.push_back( (char)toupper((unsigned char)sql[i]) );
+		i++;
+	}
+
+	if ( word != "SELECT" && word != "INSERT" && word != "UPDATE" && 
+	     word != "DELETE" && word != "REPLACE" && word != "TABLE" )
+	{
+		return false;
+	}
+
+	// nothing but blanks and comments may follow a ';'
+	bool terminated = false;
+	while( i < n )
+	{
+		char c = sql[i];
+		size_t e = skip_comment(sql,i);
+		if ( e != i )
+		{
+			i = e;
+			continue;
+		}
+		if ( terminated && !isspace((unsigned char)c) )
+		{
+			return false;
+		}
+		if ( c == ';' )
+		{
+			terminated = true;
+		}
+		else if ( c == '\'' || c == '"' || c == '`' )
+		{
+			for( i++; i < n && sql[i] != c; i++)
+			{
+				if ( sql[i] == '\\' && c != '`' )
+				{
+					i++;
+				}
+			}
+		}
+		i++;
+	}
+	return true;
+}
+
+SlowQueryLog::SlowQueryLog(const std::string& path, int threshold_ms)
+	: path_(path),
+	  threshold_(std::chrono::milliseconds(threshold_ms)),
+	  max_bytes_(0),
+	  keep_(0),
+	  explaining_(false),
+	  size_(0)
+{}
+
+SlowQueryLog::~SlowQueryLog()
+{}
+
+void SlowQueryLog::rotate(size_t max_bytes, int keep)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	max_bytes_ = max_bytes;
+	keep_ = keep;
+}
+
+void SlowQueryLog::explain(const MysqlPool& pool)
+{
+	explain_ = pool.pool_;
+}
+
+void SlowQueryLog::record(std::shared_ptr<SlowQuery> q)
+{
+	auto pool = explain_.lock();
+	if( !pool || explaining_ || !explainable(q->sql) )
+	{
+		write(q);
+		return;
+	}
+
+	explaining_ = true;
+	auto self = shared_from_this();
+
+	// the bare connection, a failing EXPLAIN leaves it in the pool
+	pool->get()
+	.then( [q](ConnectionPool::ResourcePtr r)
+	{
+		return prio::task( [q,r]()
+		{
+			q->plan = plan(r.get(),*q);
+		});
+	})
+	.then( [self,q]()
+	{
+		self->explaining_ = false;
+		self->write(q);
+	})
+	.otherwise( [self,q](const std::exception& ex)
+	{
+		self->explaining_ = false;
+		q->plan = std::string("EXPLAIN failed: ") + ex.what() + "\n";
+		self->write(q);
+	});
+}
+
+std::string SlowQueryLog::plan(MYSQL* con, const SlowQuery& q)
+{
+	StatementCache::EntryPtr e = StatementCache::prepare(con, "EXPLAIN " + q.sql);
+	if ( !e )
+	{
+		throw repro::Ex(mysql_error(con));
+	}
+	if ( e->param_count != (int)q.params.size() )
+	{
+		throw repro::Ex("parameter count does not match");
+	}
+
+	// copies share the value buffers, bind() only resets the flags
+	std::vector<Param> params(q.params);
+	for( size_t i = 0; i < params.size(); i++)
+	{
+		params[i].bind(e->bind[i]);
+	}
+
+	if ( ( !params.empty() && mysql_stmt_bind_param(e->stmt, e->bind.data()) ) ||
+	     mysql_stmt_execute(e->stmt) || 
+	     mysql_stmt_store_result(e->stmt) )
+	{
+		throw repro::Ex(mysql_stmt_error(e->stmt));
+	}
+
+	result_columns columns;
+	columns.load(e->stmt, e->meta.get());
+
+	std::ostringstream oss;
+	for( int i = 0; i < columns.fields(); i++)
+	{
+		oss << (i ? "\t" : "") << columns.column(i).name;
+	}
+	oss << "\n";
+
+	for( size_t r = 0; r < columns.rows(); r++)
+	{
+		for( int i = 0; i < columns.fields(); i++)
+		{
+			const result_columns::Column& c = columns.column(i);
+			oss << (i ? "\t" : "");
+			if ( c.null(r) )
+			{
+				oss << "NULL";
+				continue;
+			}
+			switch(c.kind)
+			{
+				case result_columns::INT64:  oss << c.ints[r]; break;
+				case result_columns::DOUBLE: oss << c.doubles[r]; break;
+				case result_columns::STRING: oss << c.str(r); break;
+			}
+		}
+		oss << "\n";
+	}
+	return oss.str();
+}
+
+void SlowQueryLog::write(std::shared_ptr<SlowQuery> q)
+{
+	auto self = shared_from_this();
+	prio::task( [self,q]()
+	{
+		self->append(*q);
+	});
+}
+
+void SlowQueryLog::append(const SlowQuery& q)
+{
+	std::time_t t = std::chrono::system_clock::to_time_t(q.when);
+	char when[32];
+	std::strftime(when, sizeof(when), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&t));
+
+	std::ostringstream oss;
+	oss << std::fixed << std::setprecision(3)
+	    << "# " << when 
+	    << " total " << q.total*1000 << " ms"
+	    << " prepare " << q.prepare*1000 << " ms"
+	    << " execute " << q.execute*1000 << " ms"
+	    << " store " << q.store*1000 << " ms"
+	    << " rows " << q.rows;
+
+	if(!q.params.empty())
+	{
+		oss << " params";
+		for( size_t i = 0; i < q.params.size(); i++)
+		{
+			oss << (i ? "," : " ") << type_name(q.params[i].type());
+		}
+	}
+	oss << "\n" << q.sql << ";\n";
+
+	if(!q.plan.empty())
+	{
+		oss << "# plan\n" << q.plan;
+	}
+	oss << "\n";
+
+	std::string entry = oss.str();
+
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	if(!out_.is_open())
+	{
+		out_.open(path_, std::ios::out | std::ios::app);
+		out_.seekp(0,std::ios::end);
+		size_ = (size_t)out_.tellp();
+	}
+
+	out_ << entry;
+	out_.flush();
+	size_ += entry.size();
+
+	if ( max_bytes_ > 0 && size_ >= max_bytes_ )
+	{
+		rotate();
+	}
+}
+
+// path.keep falls off, every other file moves up one. 
+// called with the mutex held
+
+void SlowQueryLog::rotate()
+{
+	out_.close();
+
+	if ( keep_ > 0 )
+	{
+		std::remove( (path_ + "." + std::to_string(keep_)).c_str() );
+		for ( int i = keep_-1; i > 0; i--)
+		{
+			std::rename( 
+				(path_ + "." + std::to_string(i)).c_str(), 
+				(path_ + "." + std::to_string(i+1)).c_str() 
+			);
+		}
+		std::rename( path_.c_str(), (path_ + ".1").c_str() );
+	}
+
+	out_.open(path_, std::ios::out | std::ios::trunc);
+	size_ = 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+}